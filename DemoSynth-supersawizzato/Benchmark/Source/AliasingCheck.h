@@ -0,0 +1,171 @@
+#pragma once
+#include <JuceHeader.h>
+#include "../../Source/Synth.h"
+#include "Report.h"
+
+// Aliasing check: each main waveform is played through the engine and one voice, with a single saw
+// and the sub, the noise and the filter out of the way, on notes spread over the keyboard. The
+// spectrum of each note is split into the harmonics of the note and everything else: what is not
+// harmonic is alias. The check fails when the loudest inharmonic peak, relative to the fundamental,
+// is above the threshold (-50 dB by default, the figure the plugin is designed for).
+namespace AliasingCheck
+{
+    static const char* waveformNames[] = {
+        "saw_down", "sharktooth", "triangle", "saw_up", "square", "wide_square", "narrow_square"
+    };
+
+    static const int fftOrder = 15;
+    static const int fftSize = 1 << fftOrder;
+
+    // bins on each side of a harmonic that still belong to it (Blackman-Harris main lobe plus margin)
+    static const int harmonicBins = 8;
+
+    struct Result
+    {
+        float worstAliasDb;     // loudest inharmonic peak, relative to the fundamental
+        float aliasEnergyDb;    // inharmonic energy, relative to the harmonic energy
+    };
+
+    // plays the note and keeps fftSize samples of the left channel, after the attack
+    static void renderNote(float* output, double sampleRate, int oversampling, int waveform, int note)
+    {
+        PolySynthesiser synth;
+        synth.setNumVoices(1, [&]
+        {
+            auto* voice = new SimpleSynthVoice();
+            voice->setOversamplingFactor(oversampling);
+            voice->prepareToPlay(sampleRate, RENDER_CHUNK_SIZE);
+            voice->setSawNum(1);
+            voice->setSawRegister(3);   // the note at its own pitch
+            voice->setMainWf(waveform);
+            voice->setSawGain(1.0f);
+            voice->setSubGain(0.0f);
+            voice->setNoiseGain(0.0f);
+            voice->setCutoff(19500.0f);
+            voice->setQuality(0.05f);
+            voice->setAttack(0.001f);
+            voice->setSustain(1.0f);
+            voice->setMasterGain(-6.0f);
+            return voice;
+        });
+        synth.updateVoicePool();
+
+        const int blockSize = 512;
+        const int skipped = (int)(0.1 * sampleRate);
+
+        AudioBuffer<float> block(2, blockSize);
+        MidiBuffer midi;
+        midi.addEvent(MidiMessage::noteOn(1, note, 1.0f), 0);
+
+        for (int position = 0; position < skipped + fftSize; position += blockSize)
+        {
+            block.clear();
+            synth.renderNextBlock(block, midi, 0, blockSize);
+            midi.clear();
+
+            for (int i = 0; i < blockSize; ++i)
+            {
+                const int index = position + i - skipped;
+                if (index >= 0 && index < fftSize)
+                    output[index] = block.getSample(0, i);
+            }
+        }
+    }
+
+    static Result analyse(const float* signal, double sampleRate, double fundamental)
+    {
+        HeapBlock<float> spectrum(2 * fftSize, true);
+        FloatVectorOperations::copy(spectrum.get(), signal, fftSize);
+
+        dsp::WindowingFunction<float> window((size_t)fftSize, dsp::WindowingFunction<float>::blackmanHarris, false);
+        window.multiplyWithWindowingTable(spectrum.get(), (size_t)fftSize);
+
+        dsp::FFT fft(fftOrder);
+        fft.performFrequencyOnlyForwardTransform(spectrum.get());
+
+        const double binWidth = sampleRate / fftSize;
+        const double harmonicSpacing = fundamental / binWidth;
+
+        // the leaky integrators of the BLITs leave some energy below 20 Hz, it is not alias
+        const int firstBin = (int)std::ceil(20.0 / binWidth);
+        const int fundamentalBin = roundToInt(harmonicSpacing);
+
+        float fundamentalPeak = 0.0f;
+        for (int bin = jmax(1, fundamentalBin - harmonicBins); bin <= fundamentalBin + harmonicBins; ++bin)
+            fundamentalPeak = jmax(fundamentalPeak, spectrum[bin]);
+
+        float worstAlias = 0.0f;
+        double harmonicEnergy = 0.0;
+        double aliasEnergy = 0.0;
+
+        for (int bin = firstBin; bin < fftSize / 2; ++bin)
+        {
+            const double harmonic = std::round(bin / harmonicSpacing);
+            const bool isHarmonic = harmonic >= 1.0 && std::abs(bin - harmonic * harmonicSpacing) <= harmonicBins;
+            const double energy = (double)spectrum[bin] * spectrum[bin];
+
+            if (isHarmonic)
+            {
+                harmonicEnergy += energy;
+            }
+            else
+            {
+                aliasEnergy += energy;
+                worstAlias = jmax(worstAlias, spectrum[bin]);
+            }
+        }
+
+        Result result;
+        result.worstAliasDb = Decibels::gainToDecibels(worstAlias / jmax(fundamentalPeak, 1.0e-12f), -200.0f);
+        result.aliasEnergyDb = (float)(10.0 * std::log10(jmax(aliasEnergy, 1.0e-30) / jmax(harmonicEnergy, 1.0e-30)));
+        return result;
+    }
+
+    // --aliasing [--threshold <dB>] [--rate <Hz>] [--oversampling <factor>] [--csv <file>]
+    // returns 1 when a note is above the threshold
+    static int run(const ArgumentList& args)
+    {
+        const float threshold = args.containsOption("--threshold") ? args.getValueForOption("--threshold").getFloatValue() : -50.0f;
+        const double sampleRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 48000.0;
+        const int oversampling = args.containsOption("--oversampling") ? jmax(1, args.getValueForOption("--oversampling").getIntValue()) : 2;
+
+        ScopedNoDenormals noDenormals;
+        HeapBlock<float> signal(fftSize, true);
+
+        String csv = "waveform,note,frequency,worst_alias_db,alias_energy_db,result";
+        csv << newLine;
+
+        int numNotes = 0;
+        int numFailed = 0;
+        float worstOverall = -200.0f;
+
+        // a stepped sweep: C2 to C8 by half octaves, for every waveform
+        for (int waveform = 0; waveform < numElementsInArray(waveformNames); ++waveform)
+        {
+            for (int note = 36; note <= 108; note += 6)
+            {
+                renderNote(signal.get(), sampleRate, oversampling, waveform, note);
+
+                const double fundamental = 440.0 * std::pow(2.0, (note - 69) / 12.0);
+                const auto result = analyse(signal.get(), sampleRate, fundamental);
+                const bool passed = result.worstAliasDb <= threshold;
+
+                ++numNotes;
+                if (!passed)
+                    ++numFailed;
+                worstOverall = jmax(worstOverall, result.worstAliasDb);
+
+                csv << waveformNames[waveform] << "," << note << "," << fundamental << ","
+                    << result.worstAliasDb << "," << result.aliasEnergyDb << "," << (passed ? "pass" : "FAIL") << newLine;
+            }
+        }
+
+        std::cerr << numFailed << " of " << numNotes << " notes above " << threshold << " dB, worst alias "
+                  << worstOverall << " dB" << std::endl;
+
+        if (!writeReport(args, csv))
+            return 1;
+
+        return numFailed > 0 ? 1 : 0;
+    }
+}
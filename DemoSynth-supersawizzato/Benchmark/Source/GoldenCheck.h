@@ -0,0 +1,356 @@
+#pragma once
+#include <JuceHeader.h>
+#include "../../Source/Synth.h"
+#include "Report.h"
+
+// Golden renders: a fixed set of patches plays a fixed set of MIDI phrases through the engine, and
+// each render is compared with the one stored by a reference build (committed in Benchmark/Golden).
+// Refactors of the DSP change the floating point results a little, so every test has tolerances on
+// three measures instead of requiring the same samples:
+//  - peak error: largest sample difference, in dBFS
+//  - spectral distance: log-spectral distance between the two spectrograms, in dB
+//  - loudness: difference of the RMS levels of the whole renders, in dB
+namespace GoldenCheck
+{
+    static const double sampleRate = 48000.0;
+    static const int blockSize = 256;
+    static const double renderSeconds = 3.0;
+
+    struct Setting
+    {
+        int index;      // Parameters::Index
+        float value;    // in the units of the plugin parameter
+    };
+
+    struct Tolerance
+    {
+        float peakErrorDb;
+        float spectralDistanceDb;
+        float loudnessDb;
+    };
+
+    struct Patch
+    {
+        const char* name;
+        std::vector<Setting> settings;
+        Tolerance tolerance;
+    };
+
+    // the plugin's defaults, the patches only list what they change
+    static const std::vector<Setting>& getDefaults()
+    {
+        using namespace Parameters;
+
+        static const std::vector<Setting> defaults = {
+            { mainWf, defaultMainWf }, { sawReg, defaultSawReg }, { sawNum, defaultSawNum },
+            { detune, defaultDetune }, { stereoWidth, defaultStereoWidth }, { phase, defaultPhase },
+            { sawLev, defaultSaw }, { subLev, dbFloor }, { nLev, dbFloor },
+            { atk, defaultAtk }, { dcy, defaultDcy }, { sus, defaultSus }, { rel, defaultRel },
+            { subReg, defaultSubReg }, { subWf, defaultSubWf },
+            { filtHz, defaultFiltHz }, { filtQ, defaultFiltQ }, { filtEnv, defaultFiltEnv }, { filtLfoAmt, defaultFiltLfoAmt },
+            { lfoWf, defaultLfoWf }, { lfoFreq, defaultLfoFreq }, { lfoRate, defaultLfoRate }, { lfoSync, defaultLfoSync },
+            { nRel, defaultNoiseRel }, { nFilt, defaultNFilt },
+            { master, defaultMaster }, { silence, defaultSilence }
+        };
+
+        return defaults;
+    }
+
+    // the resonant patch goes through many more Newton iterations of the ladder, it is allowed more error
+    static const std::vector<Patch>& getPatches()
+    {
+        static const std::vector<Patch> patches = {
+            { "supersaw", { { Parameters::sawNum, 7 }, { Parameters::detune, 25 }, { Parameters::stereoWidth, 0.8f },
+                            { Parameters::filtHz, 6000 }, { Parameters::filtQ, 0.2f }, { Parameters::rel, 0.5f } },
+              { -60.0f, 0.5f, 0.05f } },
+            { "square_sub", { { Parameters::mainWf, 4 }, { Parameters::sawNum, 3 }, { Parameters::subLev, -6 },
+                              { Parameters::subWf, 1 }, { Parameters::filtHz, 2000 }, { Parameters::filtEnv, 0.5f } },
+              { -60.0f, 0.5f, 0.05f } },
+            { "resonant_lfo", { { Parameters::sawNum, 1 }, { Parameters::filtHz, 800 }, { Parameters::filtQ, 0.9f },
+                                { Parameters::filtLfoAmt, 0.5f }, { Parameters::lfoFreq, 2 } },
+              { -50.0f, 1.0f, 0.1f } },
+            { "noise_pluck", { { Parameters::sawLev, -12 }, { Parameters::nLev, -6 }, { Parameters::nRel, 0.3f },
+                               { Parameters::nFilt, 0.8f }, { Parameters::atk, 0.001f }, { Parameters::dcy, 0.2f },
+                               { Parameters::sus, 0.0f }, { Parameters::rel, 0.2f } },
+              { -60.0f, 0.5f, 0.05f } },
+            { "triangle_pad", { { Parameters::mainWf, 2 }, { Parameters::sawNum, 5 }, { Parameters::atk, 0.3f },
+                                { Parameters::rel, 1.5f }, { Parameters::filtHz, 3000 } },
+              { -60.0f, 0.5f, 0.05f } }
+        };
+
+        return patches;
+    }
+
+    //==============================================================================
+    // PHRASES, sample positions at sampleRate
+
+    static void addNote(MidiBuffer& midi, int note, float velocity, double start, double length)
+    {
+        midi.addEvent(MidiMessage::noteOn(1, note, velocity), (int)(start * sampleRate));
+        midi.addEvent(MidiMessage::noteOff(1, note), (int)((start + length) * sampleRate));
+    }
+
+    static const char* phraseNames[] = { "chord", "arpeggio", "velocities" };
+
+    static MidiBuffer createPhrase(int phrase)
+    {
+        MidiBuffer midi;
+
+        switch (phrase)
+        {
+        case 0: // a held chord and its release
+            for (auto note : { 48, 55, 60, 64, 71 })
+                addNote(midi, note, 0.8f, 0.0, 1.5);
+            break;
+
+        case 1: // overlapping notes over three octaves, more than the voices: the stealing is part of it
+            for (int i = 0; i < 16; ++i)
+                addNote(midi, 36 + (i * 5) % 36, 0.7f, i * 0.125, 0.3);
+            break;
+
+        case 2: // the same note at increasing velocities
+            for (int i = 0; i < 5; ++i)
+                addNote(midi, 57, 0.2f + 0.2f * i, i * 0.5, 0.4);
+            break;
+
+        default:
+            break;
+        }
+
+        return midi;
+    }
+
+    // the patch plays the phrase on the plugin's default voice count
+    static AudioBuffer<float> render(const Patch& patch, int phrase)
+    {
+        PolySynthesiser synth;
+        synth.setNumVoices(Parameters::defaultVoices, [&patch]
+        {
+            auto* voice = new SimpleSynthVoice();
+            voice->prepareToPlay(sampleRate, RENDER_CHUNK_SIZE);
+            for (const auto& setting : getDefaults())
+                voice->setParameter(setting.index, setting.value);
+            for (const auto& setting : patch.settings)
+                voice->setParameter(setting.index, setting.value);
+            return voice;
+        });
+        synth.updateVoicePool();
+
+        const auto phraseMidi = createPhrase(phrase);
+        const int numSamples = (int)(renderSeconds * sampleRate);
+
+        AudioBuffer<float> output(2, numSamples);
+        output.clear();
+
+        MidiBuffer midi;
+        for (int position = 0; position < numSamples; position += blockSize)
+        {
+            const int blockLength = jmin(blockSize, numSamples - position);
+
+            midi.clear();
+            midi.addEvents(phraseMidi, position, blockLength, -position);
+
+            AudioBuffer<float> block(output.getArrayOfWritePointers(), 2, position, blockLength);
+            synth.renderNextBlock(block, midi, 0, blockLength);
+        }
+
+        return output;
+    }
+
+    //==============================================================================
+    // MEASURES
+
+    static float peakErrorDb(const AudioBuffer<float>& rendered, const AudioBuffer<float>& golden)
+    {
+        float peak = 0.0f;
+
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < rendered.getNumSamples(); ++i)
+                peak = jmax(peak, std::abs(rendered.getSample(ch, i) - golden.getSample(ch, i)));
+
+        return Decibels::gainToDecibels(peak, -200.0f);
+    }
+
+    static float loudnessDifferenceDb(const AudioBuffer<float>& rendered, const AudioBuffer<float>& golden)
+    {
+        auto rmsDb = [] (const AudioBuffer<float>& buffer)
+        {
+            double sum = 0.0;
+            for (int ch = 0; ch < 2; ++ch)
+                for (int i = 0; i < buffer.getNumSamples(); ++i)
+                    sum += (double)buffer.getSample(ch, i) * buffer.getSample(ch, i);
+
+            return 10.0 * std::log10(jmax(sum / (2.0 * buffer.getNumSamples()), 1.0e-20));
+        };
+
+        return (float)std::abs(rmsDb(rendered) - rmsDb(golden));
+    }
+
+    // mean over the frames of the RMS difference of the dB spectra, on the bins that are audible
+    // (above -100 dBFS) in one of the two renders, mid channel
+    static float spectralDistanceDb(const AudioBuffer<float>& rendered, const AudioBuffer<float>& golden)
+    {
+        const int order = 11;
+        const int frameSize = 1 << order;
+        const int hop = frameSize / 2;
+
+        dsp::FFT fft(order);
+        dsp::WindowingFunction<float> window((size_t)frameSize, dsp::WindowingFunction<float>::hann, false);
+        HeapBlock<float> a(2 * frameSize, true);
+        HeapBlock<float> b(2 * frameSize, true);
+
+        double distanceSum = 0.0;
+        int numFrames = 0;
+
+        for (int start = 0; start + frameSize <= rendered.getNumSamples(); start += hop)
+        {
+            for (int i = 0; i < frameSize; ++i)
+            {
+                a[i] = 0.5f * (rendered.getSample(0, start + i) + rendered.getSample(1, start + i));
+                b[i] = 0.5f * (golden.getSample(0, start + i) + golden.getSample(1, start + i));
+            }
+
+            window.multiplyWithWindowingTable(a.get(), (size_t)frameSize);
+            window.multiplyWithWindowingTable(b.get(), (size_t)frameSize);
+            fft.performFrequencyOnlyForwardTransform(a.get());
+            fft.performFrequencyOnlyForwardTransform(b.get());
+
+            double squares = 0.0;
+            int numBins = 0;
+
+            for (int bin = 1; bin < frameSize / 2; ++bin)
+            {
+                // magnitudes normalised so that a full-scale sine reads about 0 dB
+                const float levelA = Decibels::gainToDecibels(a[bin] * 4.0f / frameSize, -200.0f);
+                const float levelB = Decibels::gainToDecibels(b[bin] * 4.0f / frameSize, -200.0f);
+
+                if (jmax(levelA, levelB) < -100.0f)
+                    continue;
+
+                const double difference = jmax(levelA, -100.0f) - jmax(levelB, -100.0f);
+                squares += difference * difference;
+                ++numBins;
+            }
+
+            if (numBins > 0)
+            {
+                distanceSum += std::sqrt(squares / numBins);
+                ++numFrames;
+            }
+        }
+
+        return numFrames > 0 ? (float)(distanceSum / numFrames) : 0.0f;
+    }
+
+    //==============================================================================
+    // WAV FILES, 32 bit float
+
+    static bool writeWav(const File& file, const AudioBuffer<float>& buffer)
+    {
+        file.deleteFile();
+        std::unique_ptr<FileOutputStream> stream(file.createOutputStream());
+
+        if (stream == nullptr)
+            return false;
+
+        WavAudioFormat wav;
+        std::unique_ptr<AudioFormatWriter> writer(wav.createWriterFor(stream.get(), sampleRate, 2, 32, {}, 0));
+
+        if (writer == nullptr)
+            return false;
+
+        stream.release();   // owned by the writer now
+        return writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+    }
+
+    static bool readWav(const File& file, AudioBuffer<float>& buffer)
+    {
+        AudioFormatManager formats;
+        formats.registerBasicFormats();
+        std::unique_ptr<AudioFormatReader> reader(formats.createReaderFor(file));
+
+        if (reader == nullptr || reader->numChannels != 2)
+            return false;
+
+        buffer.setSize(2, (int)reader->lengthInSamples);
+        return reader->read(&buffer, 0, (int)reader->lengthInSamples, 0, true, true);
+    }
+
+    //==============================================================================
+    // --golden <folder> [--write] [--csv <file>]
+    // --write stores the renders of this build as the new golden files, otherwise they are compared
+    // with the stored ones; returns 1 when a test is out of its tolerances or has no golden file
+    static int run(const ArgumentList& args)
+    {
+        const auto folder = args.getFileForOption("--golden");
+        const bool writing = args.containsOption("--write");
+
+        if (writing && !folder.createDirectory())
+        {
+            std::cerr << "Cannot create " << folder.getFullPathName() << std::endl;
+            return 1;
+        }
+
+        ScopedNoDenormals noDenormals;
+
+        String csv = "test,peak_error_db,spectral_distance_db,loudness_diff_db,result";
+        csv << newLine;
+        int numFailed = 0;
+        int numTests = 0;
+
+        for (const auto& patch : getPatches())
+        {
+            for (int phrase = 0; phrase < numElementsInArray(phraseNames); ++phrase)
+            {
+                const String name = String(patch.name) + "_" + phraseNames[phrase];
+                const auto file = folder.getChildFile(name + ".wav");
+                const auto rendered = render(patch, phrase);
+                ++numTests;
+
+                if (writing)
+                {
+                    if (!writeWav(file, rendered))
+                    {
+                        std::cerr << "Cannot write " << file.getFullPathName() << std::endl;
+                        return 1;
+                    }
+
+                    csv << name << ",,,,written" << newLine;
+                    continue;
+                }
+
+                AudioBuffer<float> golden;
+                if (!readWav(file, golden) || golden.getNumSamples() != rendered.getNumSamples())
+                {
+                    ++numFailed;
+                    csv << name << ",,,,MISSING" << newLine;
+                    continue;
+                }
+
+                const float peakError = peakErrorDb(rendered, golden);
+                const float spectralDistance = spectralDistanceDb(rendered, golden);
+                const float loudness = loudnessDifferenceDb(rendered, golden);
+
+                const auto& tolerance = patch.tolerance;
+                const bool passed = peakError <= tolerance.peakErrorDb
+                                 && spectralDistance <= tolerance.spectralDistanceDb
+                                 && loudness <= tolerance.loudnessDb;
+                if (!passed)
+                    ++numFailed;
+
+                csv << name << "," << peakError << "," << spectralDistance << "," << loudness << ","
+                    << (passed ? "pass" : "FAIL") << newLine;
+            }
+        }
+
+        if (writing)
+            std::cerr << numTests << " golden renders written to " << folder.getFullPathName() << std::endl;
+        else
+            std::cerr << numFailed << " of " << numTests << " golden tests failed" << std::endl;
+
+        if (!writeReport(args, csv))
+            return 1;
+
+        return numFailed > 0 ? 1 : 0;
+    }
+}
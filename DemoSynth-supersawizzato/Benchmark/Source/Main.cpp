@@ -0,0 +1,374 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Supercore benchmark: renders the voice pipeline with no host, no GUI and
+    no audio device, and reports its cost as CSV. With --aliasing it checks
+    the spectral quality of the oscillators instead, with --golden it
+    compares the renders of a set of patches with stored reference renders,
+    with --rtcheck it looks for allocations and locks in processBlock, with
+    --resources it reports the memory of the shared DSP tables, with
+    --prepare it times the start-up of the processor.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/Synth.h"
+#include "Report.h"
+#include "AliasingCheck.h"
+#include "GoldenCheck.h"
+#include "RealtimeCheck.h"
+#include "ResourceReport.h"
+#include "PrepareTiming.h"
+
+namespace
+{
+    // one point of the settings matrix
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 256;
+        int oversampling = 2;
+        int voices = 8;
+        int saws = 7;
+        int waveform = 0;
+        float resonance = 0.05f;
+    };
+
+    struct Case
+    {
+        String sweep;
+        Settings settings;
+    };
+
+    enum Stage
+    {
+        saws = 0, decimator, sub, noise, mixer, filter, ampEnvelope,
+        numStages
+    };
+
+    static const char* stageNames[numStages] = {
+        "saws_ns", "decimator_ns", "sub_ns", "noise_ns", "mixer_ns", "filter_ns", "amp_env_ns"
+    };
+
+    //==============================================================================
+    // the voice as the plugin sets it up, with every source audible
+    void configureVoice(SimpleSynthVoice& voice, const Settings& settings)
+    {
+        voice.setSawNum(settings.saws);
+        voice.setMainWf(settings.waveform);
+        voice.setQuality(settings.resonance);
+        voice.setCutoff(Parameters::defaultFiltHz);
+        voice.setSawGain(1.0f);
+        voice.setSubGain(Decibels::decibelsToGain(-6.0f));
+        voice.setNoiseGain(Decibels::decibelsToGain(-12.0f));
+        voice.setNoiseRelease(Parameters::defaultNoiseRel);
+        voice.setRelease(Parameters::defaultRel);
+        voice.setMasterGain(-6.0f);
+    }
+
+    // a chord with one note per voice, released after 0.75 s and struck again every second,
+    // so the attacks, the release tails and the stealing are all part of the measure
+    void addScriptedMidi(MidiBuffer& midi, const Settings& settings, int64 blockStart, int numSamples)
+    {
+        const int64 period = (int64)settings.sampleRate;
+        const int64 release = period * 3 / 4;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const int64 position = (blockStart + i) % period;
+
+            for (int v = 0; v < settings.voices; ++v)
+            {
+                const int note = 36 + (v * 7) % 48;
+
+                if (position == 0)
+                    midi.addEvent(MidiMessage::noteOn(1, note, 0.8f), i);
+                else if (position == release)
+                    midi.addEvent(MidiMessage::noteOff(1, note), i);
+            }
+        }
+    }
+
+    //==============================================================================
+    // whole pipeline: MIDI dispatch, voice allocation and every voice stage, ns per output sample
+    double timePipeline(const Settings& settings, double seconds)
+    {
+        PolySynthesiser synth;
+        synth.setNumVoices(settings.voices, [&settings]
+        {
+            auto* voice = new SimpleSynthVoice();
+            voice->setOversamplingFactor(settings.oversampling);
+            voice->prepareToPlay(settings.sampleRate, RENDER_CHUNK_SIZE);
+            configureVoice(*voice, settings);
+            return voice;
+        });
+        synth.updateVoicePool();
+
+        AudioBuffer<float> buffer(2, settings.blockSize);
+        MidiBuffer midi;
+        midi.ensureSize(4096);
+
+        const int64 warmUp = (int64)(0.25 * settings.sampleRate);
+        const int64 total = warmUp + (int64)(seconds * settings.sampleRate);
+        int64 measuredSamples = 0;
+        int64 ticks = 0;
+
+        for (int64 position = 0; position < total; position += settings.blockSize)
+        {
+            const int numSamples = (int)jmin((int64)settings.blockSize, total - position);
+
+            midi.clear();
+            addScriptedMidi(midi, settings, position, numSamples);
+
+            const int64 start = Time::getHighResolutionTicks();
+            buffer.clear();
+            synth.renderNextBlock(buffer, midi, 0, numSamples);
+            const int64 elapsed = Time::getHighResolutionTicks() - start;
+
+            if (position >= warmUp)
+            {
+                ticks += elapsed;
+                measuredSamples += numSamples;
+            }
+        }
+
+        return Time::highResolutionTicksToSeconds(ticks) * 1.0e9 / (double)jmax((int64)1, measuredSamples);
+    }
+
+    //==============================================================================
+    // PER-STAGE MICROBENCHMARKS: each stage of one voice alone, chunk by chunk as the voice runs it,
+    // ns per output sample
+
+    template <typename RenderChunk>
+    double timeChunks(const Settings& settings, double seconds, RenderChunk&& renderChunk)
+    {
+        const int numChunks = jmax(1, (int)(seconds * settings.sampleRate) / RENDER_CHUNK_SIZE);
+
+        const int64 start = Time::getHighResolutionTicks();
+        for (int c = 0; c < numChunks; ++c)
+            renderChunk(c);
+        const int64 elapsed = Time::getHighResolutionTicks() - start;
+
+        return Time::highResolutionTicksToSeconds(elapsed) * 1.0e9 / ((double)numChunks * RENDER_CHUNK_SIZE);
+    }
+
+    void timeStages(const Settings& settings, double seconds, double* result)
+    {
+        const int chunkOS = RENDER_CHUNK_SIZE * settings.oversampling;
+        const double sampleRateOS = settings.sampleRate * settings.oversampling;
+
+        dsp::ProcessSpec monoSpec { settings.sampleRate, (uint32)RENDER_CHUNK_SIZE, 1 };
+        dsp::ProcessSpec stereoSpecOS { sampleRateOS, (uint32)chunkOS, 2 };
+
+        AudioBuffer<float> oversampled(2, chunkOS);
+        AudioBuffer<float> oscillators(2, RENDER_CHUNK_SIZE);
+        AudioBuffer<float> subBuffer(1, RENDER_CHUNK_SIZE);
+        AudioBuffer<float> noiseBuffer(1, RENDER_CHUNK_SIZE);
+        AudioBuffer<float> mixed(2, RENDER_CHUNK_SIZE);
+        AudioBuffer<float> output(2, RENDER_CHUNK_SIZE);
+        AudioBuffer<double> envelope(1, RENDER_CHUNK_SIZE);
+        AudioBuffer<double> modulation(2, RENDER_CHUNK_SIZE);
+        envelope.clear();
+        modulation.clear();
+
+        SawOscillators sawOscs;
+        sawOscs.prepareToPlay(stereoSpecOS);
+        sawOscs.setActiveOscs(settings.saws);
+        sawOscs.setWf(settings.waveform);
+        result[saws] = timeChunks(settings, seconds, [&] (int)
+        {
+            oversampled.clear();
+            sawOscs.process(oversampled, 220.0, 0, chunkOS);
+        });
+
+        Oversampling oSmp;
+        oSmp.prepareToPlay((int)sampleRateOS, (int)settings.sampleRate, chunkOS);
+        result[decimator] = timeChunks(settings, seconds, [&] (int)
+        {
+            oSmp.filterAndDecimate(oversampled, oscillators, 0, chunkOS, settings.oversampling);
+        });
+
+        SubOscillator subOscillator;
+        subOscillator.prepareToPlay(settings.sampleRate);
+        subOscillator.setFrequency(110.0);
+        result[sub] = timeChunks(settings, seconds, [&] (int)
+        {
+            subOscillator.getNextAudioBlock(subBuffer, 0, RENDER_CHUNK_SIZE);
+        });
+
+        // struck again every second, like the notes of the pipeline
+        NoiseOsc noiseOsc;
+        noiseOsc.prepareToPlay(monoSpec);
+        noiseOsc.setRelease(Parameters::defaultNoiseRel);
+        const int chunksPerSecond = jmax(1, (int)settings.sampleRate / RENDER_CHUNK_SIZE);
+        result[noise] = timeChunks(settings, seconds, [&] (int chunk)
+        {
+            if (chunk % chunksPerSecond == 0)
+                noiseOsc.trigger(0, 0.8f);
+
+            noiseBuffer.clear();
+            noiseOsc.process(noiseBuffer, 0, RENDER_CHUNK_SIZE, Decibels::decibelsToGain(-12.0f));
+        });
+
+        Mixer mix;
+        mix.prepareToPlay((int)settings.sampleRate);
+        mix.setSubGain(Decibels::decibelsToGain(-6.0f));
+        mix.setNoiseGain(Decibels::decibelsToGain(-12.0f));
+        result[mixer] = timeChunks(settings, seconds, [&] (int)
+        {
+            mixed.clear();
+            mix.getNextAudioBlock(mixed, oscillators, subBuffer, noiseBuffer, 0, RENDER_CHUNK_SIZE, 0.8f, settings.saws);
+            mix.applyMasterGainAndCopy(output, mixed, 0, RENDER_CHUNK_SIZE);
+        });
+
+        // the filter gets fresh oscillator output every chunk, as in the voice
+        MoogFilters moogFilter;
+        moogFilter.prepareToPlay(settings.sampleRate);
+        moogFilter.setCutoff(Parameters::defaultFiltHz);
+        moogFilter.setResonance(settings.resonance);
+        result[filter] = timeChunks(settings, seconds, [&] (int)
+        {
+            mixed.makeCopyOf(oscillators, true);
+            moogFilter.process(mixed, envelope, modulation, 0, RENDER_CHUNK_SIZE);
+        });
+
+        MyADSR ampAdsr;
+        ampAdsr.prepareToPlay(settings.sampleRate);
+        ampAdsr.noteOn();
+        result[ampEnvelope] = timeChunks(settings, seconds, [&] (int)
+        {
+            ampAdsr.applyEnvelopeToBuffer(mixed, 0, RENDER_CHUNK_SIZE);
+        });
+    }
+
+    //==============================================================================
+    // the baseline, then one parameter at a time around it; the full cross product on request
+    Array<Case> buildMatrix(bool full)
+    {
+        const int sawCounts[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+        const int waveforms[] = { 0, 1, 2, 3, 4, 5, 6 };
+        const float resonances[] = { 0.05f, 0.25f, 0.5f, 0.75f, 1.0f };
+        const int oversamplings[] = { 1, 2, 4 };
+        const double sampleRates[] = { 44100.0, 48000.0, 96000.0 };
+        const int blockSizes[] = { 32, 64, 128, 256, 512, 1024 };
+        const int voiceCounts[] = { 1, 4, 8, 16, 32, 64 };
+
+        Array<Case> matrix;
+        const Settings baseline;
+
+        if (full)
+        {
+            for (auto rate : sampleRates) for (auto block : blockSizes) for (auto os : oversamplings)
+            for (auto voices : voiceCounts) for (auto n : sawCounts) for (auto wf : waveforms) for (auto q : resonances)
+            {
+                Settings s;
+                s.sampleRate = rate; s.blockSize = block; s.oversampling = os;
+                s.voices = voices; s.saws = n; s.waveform = wf; s.resonance = q;
+                matrix.add({ "full", s });
+            }
+            return matrix;
+        }
+
+        matrix.add({ "baseline", baseline });
+
+        for (auto n : sawCounts)      { auto s = baseline; s.saws = n;         matrix.add({ "saws", s }); }
+        for (auto wf : waveforms)     { auto s = baseline; s.waveform = wf;    matrix.add({ "waveform", s }); }
+        for (auto q : resonances)     { auto s = baseline; s.resonance = q;    matrix.add({ "resonance", s }); }
+        for (auto os : oversamplings) { auto s = baseline; s.oversampling = os; matrix.add({ "oversampling", s }); }
+        for (auto rate : sampleRates) { auto s = baseline; s.sampleRate = rate; matrix.add({ "sample_rate", s }); }
+        for (auto block : blockSizes) { auto s = baseline; s.blockSize = block; matrix.add({ "block_size", s }); }
+        for (auto v : voiceCounts)    { auto s = baseline; s.voices = v;       matrix.add({ "voices", s }); }
+
+        return matrix;
+    }
+
+    void printUsage()
+    {
+        std::cout << "SupercoreBenchmark [--csv <file>] [--seconds <s>] [--full]" << std::endl
+                  << "  --csv      write the results to a file instead of the standard output" << std::endl
+                  << "  --seconds  audio rendered per case, 2 by default" << std::endl
+                  << "  --full     whole cross product of the settings instead of one sweep per setting (very long)" << std::endl
+                  << std::endl
+                  << "SupercoreBenchmark --aliasing [--threshold <dB>] [--rate <Hz>] [--oversampling <factor>] [--csv <file>]" << std::endl
+                  << "  alias level of every waveform over the keyboard, exits with 1 above the threshold (-50 dB by default)" << std::endl
+                  << std::endl
+                  << "SupercoreBenchmark --golden <folder> [--write] [--csv <file>]" << std::endl
+                  << "  compares the renders of the test patches with the golden files in the folder, exits with 1 out of tolerance" << std::endl
+                  << "  --write  stores the renders of this build as the golden files instead" << std::endl
+                  << std::endl
+                  << "SupercoreBenchmark --rtcheck [--seconds <s>] [--block <samples>] [--csv <file>]" << std::endl
+                  << "  dense MIDI and automation through the processor, exits with 1 if processBlock allocates or locks" << std::endl
+                  << std::endl
+                  << "SupercoreBenchmark --resources [--instances <n>] [--rate <Hz>] [--csv <file>]" << std::endl
+                  << "  the shared DSP tables used by the voices of n instances (30 by default), with their users and sizes" << std::endl
+                  << std::endl
+                  << "SupercoreBenchmark --prepare [--block <samples>] [--csv <file>]" << std::endl
+                  << "  times the construction and prepareToPlay of the processor, and the first block with notes against the next ones" << std::endl;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+
+    if (args.containsOption("--aliasing"))
+        return AliasingCheck::run(args);
+
+    if (args.containsOption("--golden"))
+        return GoldenCheck::run(args);
+
+    if (args.containsOption("--rtcheck"))
+        return RealtimeCheck::run(args);
+
+    if (args.containsOption("--resources"))
+        return ResourceReport::run(args);
+
+    if (args.containsOption("--prepare"))
+        return PrepareTiming::run(args);
+
+    const double seconds = args.containsOption("--seconds") ? jmax(0.1, args.getValueForOption("--seconds").getDoubleValue()) : 2.0;
+    auto matrix = buildMatrix(args.containsOption("--full"));
+
+    ScopedNoDenormals noDenormals;
+
+    // ns per output sample for the whole engine, and per voice for each stage
+    String csv = "sweep,sample_rate,block_size,oversampling,voices,saws,waveform,resonance,"
+                 "ns_per_sample,ns_per_voice_sample,realtime_percent,realtime_percent_48k";
+    for (auto* name : stageNames)
+        csv << "," << name;
+    csv << newLine;
+
+    for (int i = 0; i < matrix.size(); ++i)
+    {
+        const auto& name = matrix.getReference(i).sweep;
+        const auto& settings = matrix.getReference(i).settings;
+
+        std::cerr << "[" << (i + 1) << "/" << matrix.size() << "] " << name << std::endl;
+
+        const double nsPerSample = timePipeline(settings, seconds);
+        double stages[numStages];
+        timeStages(settings, seconds, stages);
+
+        // share of the time available at the case's own rate, and at 48 kHz
+        const double realtimePercent = nsPerSample * settings.sampleRate * 1.0e-7;
+        const double realtimePercent48k = nsPerSample * 48000.0 * 1.0e-7;
+
+        csv << name << "," << settings.sampleRate << "," << settings.blockSize << "," << settings.oversampling << ","
+            << settings.voices << "," << settings.saws << "," << settings.waveform << "," << settings.resonance << ","
+            << nsPerSample << "," << nsPerSample / settings.voices << "," << realtimePercent << "," << realtimePercent48k;
+        for (auto stage : stages)
+            csv << "," << stage;
+        csv << newLine;
+    }
+
+    return writeReport(args, csv) ? 0 : 1;
+}
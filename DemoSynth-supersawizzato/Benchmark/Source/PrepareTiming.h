@@ -0,0 +1,74 @@
+#pragma once
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+#include "Report.h"
+
+// Start-up timing of the processor, as a host loading a project sees it: construction, the first
+// prepareToPlay, a second one with the same settings (which should cost next to nothing), one at
+// another sample rate, then the block in which the first chord starts against the blocks after it.
+// A first block much slower than the steady ones means something was left for the first note.
+namespace PrepareTiming
+{
+    static double millisecondsSince(const int64 start)
+    {
+        return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1000.0;
+    }
+
+    // --prepare [--block <samples>] [--csv <file>]
+    static int run(const ArgumentList& args)
+    {
+        const int blockSize = args.containsOption("--block") ? jlimit(16, 4096, args.getValueForOption("--block").getIntValue()) : 512;
+
+        // the parameters of the processor need a message manager
+        ScopedJuceInitialiser_GUI juceInitialiser;
+        ScopedNoDenormals noDenormals;
+
+        String csv = "step,ms";
+        csv << newLine;
+
+        int64 start = Time::getHighResolutionTicks();
+        DemoSynthAudioProcessor processor;
+        csv << "construct," << millisecondsSince(start) << newLine;
+
+        processor.setPlayConfigDetails(0, 2, 48000.0, blockSize);
+
+        start = Time::getHighResolutionTicks();
+        processor.prepareToPlay(48000.0, blockSize);
+        csv << "prepare_48000," << millisecondsSince(start) << newLine;
+
+        start = Time::getHighResolutionTicks();
+        processor.prepareToPlay(48000.0, blockSize);
+        csv << "prepare_again," << millisecondsSince(start) << newLine;
+
+        start = Time::getHighResolutionTicks();
+        processor.prepareToPlay(44100.0, blockSize);
+        csv << "prepare_44100," << millisecondsSince(start) << newLine;
+
+        processor.prepareToPlay(48000.0, blockSize);
+
+        // one note per voice, held
+        AudioBuffer<float> buffer(2, blockSize);
+        MidiBuffer chord;
+        for (int v = 0; v < Parameters::defaultVoices; ++v)
+            chord.addEvent(MidiMessage::noteOn(1, 48 + v * 3, 0.8f), 0);
+        MidiBuffer noMidi;
+
+        start = Time::getHighResolutionTicks();
+        processor.processBlock(buffer, chord);
+        csv << "first_note_block," << millisecondsSince(start) << newLine;
+
+        Array<double> steady;
+        for (int block = 0; block < 99; ++block)
+        {
+            start = Time::getHighResolutionTicks();
+            processor.processBlock(buffer, noMidi);
+            steady.add(millisecondsSince(start));
+        }
+        std::sort(steady.begin(), steady.end());
+        csv << "steady_block_median," << steady[steady.size() / 2] << newLine;
+
+        processor.releaseResources();
+
+        return writeReport(args, csv) ? 0 : 1;
+    }
+}
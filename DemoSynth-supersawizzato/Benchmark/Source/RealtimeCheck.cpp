@@ -0,0 +1,516 @@
+/*
+  ==============================================================================
+
+    RealtimeCheck.cpp
+    Interposed allocation and locking functions: while a thread is armed,
+    every call it makes to them is recorded with its stack. On Linux the
+    malloc family (aligned allocations included), free, pthread_mutex_lock
+    and trylock and the pthread_cond functions are replaced, which also
+    covers operator new, every JUCE lock and every wait on a condition;
+    elsewhere only operator new and delete are.
+
+  ==============================================================================
+*/
+
+#include "RealtimeCheck.h"
+#include "../../Source/PluginProcessor.h"
+#include "Report.h"
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <execinfo.h>
+#endif
+
+#if JUCE_LINUX
+ #include <dlfcn.h>
+ #include <pthread.h>
+ #include <cerrno>
+
+extern "C"
+{
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void* __libc_memalign(size_t, size_t);
+    void __libc_free(void*);
+}
+#endif
+
+namespace RealtimeCheck
+{
+    static const int maxRecords = 256;
+    static const int maxFrames = 24;
+
+    struct Record
+    {
+        const char* call;
+        int numFrames;
+        void* frames[maxFrames];
+    };
+
+    // fixed storage, the recorder itself must not allocate
+    static Record records[maxRecords];
+    static std::atomic<int> numRecords { 0 };
+    static std::atomic<int> numDropped { 0 };
+
+    static thread_local bool armed = false;
+    static thread_local bool recording = false;
+
+    // the plug-in's own threads (render workers, render-ahead), recognised by their name
+    static std::atomic<bool> watchingHelpers { false };
+    static thread_local bool helper = false;
+
+    static bool isHelperThread()
+    {
+       #if JUCE_LINUX
+        if (!helper)
+        {
+            char name[16] = {};
+            helper = pthread_getname_np(pthread_self(), name, sizeof(name)) == 0
+                  && std::strncmp(name, "Supercore ", 10) == 0;
+        }
+       #endif
+        return helper;
+    }
+
+    static void record(const char* call)
+    {
+        if (recording || !(armed || (watchingHelpers.load(std::memory_order_relaxed) && isHelperThread())))
+            return;
+
+        recording = true;
+
+        const int index = numRecords.fetch_add(1);
+        if (index < maxRecords)
+        {
+            auto& r = records[index];
+            r.call = call;
+           #if JUCE_LINUX || JUCE_MAC
+            r.numFrames = backtrace(r.frames, maxFrames);
+           #else
+            r.numFrames = 0;
+           #endif
+        }
+        else
+        {
+            numRecords.fetch_sub(1);
+            numDropped.fetch_add(1);
+        }
+
+        recording = false;
+    }
+
+    // the calling thread is watched until disarm()
+    static void arm()
+    {
+       #if JUCE_LINUX || JUCE_MAC
+        // the first backtrace loads the unwinder, which allocates
+        void* frames[4];
+        backtrace(frames, 4);
+       #endif
+        armed = true;
+    }
+
+    static void disarm()
+    {
+        armed = false;
+    }
+
+    // every helper thread of the plug-in is watched until unwatchHelpers(), whatever it is doing
+    static void watchHelpers()
+    {
+        watchingHelpers = true;
+    }
+
+    static void unwatchHelpers()
+    {
+        watchingHelpers = false;
+    }
+
+    // false where only operator new and delete are interposed
+    static bool coversMallocAndLocks()
+    {
+        return JUCE_LINUX != 0;
+    }
+
+    static int getNumRecords()   { return numRecords.load(); }
+    static int getNumDropped()   { return numDropped.load(); }     // records beyond maxRecords
+    static const Record& getRecord(int index)   { return records[index]; }
+
+    static void clear()
+    {
+        numRecords = 0;
+        numDropped = 0;
+    }
+
+    // one line per frame, the interposition frames left out
+    static StringArray symbolise(const Record& r)
+    {
+        StringArray lines;
+
+       #if JUCE_LINUX || JUCE_MAC
+        if (char** symbols = backtrace_symbols(r.frames, r.numFrames))
+        {
+            // the first two frames are record() and the interposed function
+            for (int i = 2; i < r.numFrames; ++i)
+                lines.add(symbols[i]);
+            free(symbols);
+        }
+       #endif
+
+        return lines;
+    }
+
+    static bool sameStack(const Record& a, const Record& b)
+    {
+        return a.call == b.call && a.numFrames == b.numFrames
+            && std::equal(a.frames, a.frames + a.numFrames, b.frames);
+    }
+
+    //==============================================================================
+    static void setParameter(AudioProcessor& processor, const String& id, float value)
+    {
+        for (auto* parameter : processor.getParameters())
+            if (auto* ranged = dynamic_cast<RangedAudioParameter*>(parameter))
+                if (ranged->getParameterID() == id)
+                    ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+    }
+
+    // one run of the host's loop; returns the number of blocks in which something was recorded.
+    // With the engine on, the voices are rendered in parallel and ahead, render-ahead being switched
+    // off and on again every two seconds, and the plug-in's threads are watched as well. The engine
+    // parameters are automated like the others in both passes
+    static int runPass(const bool engine, const double seconds, const int blockSize, const double sampleRate, int& numBlocks)
+    {
+        DemoSynthAudioProcessor processor;
+        processor.setPlayConfigDetails(0, 2, sampleRate, blockSize);
+
+        // applied by prepareToPlay, which completes the pending resize and starts the workers
+        if (engine)
+        {
+            setParameter(processor, Parameters::nameVoices, 16.0f);
+            setParameter(processor, Parameters::nameRenderThreads, 3.0f);
+            setParameter(processor, Parameters::nameParallelVoices, 2.0f);
+            setParameter(processor, Parameters::nameRenderAhead, 1.0f);
+        }
+
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        Array<RangedAudioParameter*> automated;
+        for (auto* parameter : processor.getParameters())
+            if (auto* ranged = dynamic_cast<RangedAudioParameter*>(parameter))
+                automated.add(ranged);
+
+        // the processor's listener, called again on the armed thread for the parameters moved in
+        // the block, as the hosts that automate on the audio thread do; JUCE's own notification,
+        // which locks its listener lists, stays outside
+        AudioProcessorValueTreeState::Listener& listener = processor;
+        RangedAudioParameter* moved[5];
+        int numMoved = 0;
+
+        Random random(42);
+        AudioBuffer<float> buffer(2, blockSize);
+        MidiBuffer midi;
+        midi.ensureSize(4096);
+        bool held[128] = { false };
+
+        numBlocks = (int)(seconds * sampleRate / blockSize);
+        const int releaseEvery = (int)(3.0 * sampleRate / blockSize);
+        const int toggleEvery = (int)(2.0 * sampleRate / blockSize);
+        bool ahead = true;
+        int blocksWithRecords = 0;
+
+        if (engine)
+            watchHelpers();
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            // the host's side: four parameters moved and about eight MIDI events per block
+            numMoved = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                moved[numMoved] = automated[random.nextInt(automated.size())];
+                moved[numMoved++]->setValueNotifyingHost(random.nextFloat());
+            }
+
+            if (engine && block % toggleEvery == toggleEvery - 1)
+            {
+                ahead = !ahead;
+                setParameter(processor, Parameters::nameRenderAhead, ahead ? 1.0f : 0.0f);
+
+                for (auto* parameter : automated)
+                    if (parameter->getParameterID() == Parameters::nameRenderAhead)
+                        moved[numMoved++] = parameter;
+            }
+
+            midi.clear();
+            for (int i = 0; i < 6; ++i)
+            {
+                const int note = 36 + random.nextInt(48);
+                const int time = random.nextInt(blockSize);
+
+                if (held[note])
+                    midi.addEvent(MidiMessage::noteOff(1, note), time);
+                else
+                    midi.addEvent(MidiMessage::noteOn(1, note, 0.1f + 0.9f * random.nextFloat()), time);
+
+                held[note] = !held[note];
+            }
+            midi.addEvent(MidiMessage::pitchWheel(1, random.nextInt(16384)), random.nextInt(blockSize));
+            midi.addEvent(MidiMessage::controllerEvent(1, 1, random.nextInt(128)), random.nextInt(blockSize));
+
+            // every few seconds everything is let go, so that voices also tail off and end
+            if (block % releaseEvery == releaseEvery - 1)
+            {
+                for (int note = 0; note < 128; ++note)
+                    if (held[note])
+                        midi.addEvent(MidiMessage::noteOff(1, note), blockSize - 1);
+                std::fill(held, held + 128, false);
+            }
+
+            const int before = getNumRecords() + getNumDropped();
+
+            arm();
+            for (int i = 0; i < numMoved; ++i)
+                listener.parameterChanged(moved[i]->getParameterID(), moved[i]->convertFrom0to1(moved[i]->getValue()));
+            processor.processBlock(buffer, midi);
+            disarm();
+
+            if (getNumRecords() + getNumDropped() > before)
+                ++blocksWithRecords;
+        }
+
+        unwatchHelpers();
+        processor.releaseResources();
+
+        return blocksWithRecords;
+    }
+
+    int run(const ArgumentList& args)
+    {
+        const double seconds = args.containsOption("--seconds") ? jmax(0.1, args.getValueForOption("--seconds").getDoubleValue()) : 10.0;
+        const int blockSize = args.containsOption("--block") ? jlimit(16, 4096, args.getValueForOption("--block").getIntValue()) : 256;
+        const double sampleRate = 48000.0;
+
+        // the parameters of the processor need a message manager
+        ScopedJuceInitialiser_GUI juceInitialiser;
+
+        // one row per pass, distinct call and stack
+        String csv = "pass,call,count,stack";
+        csv << newLine;
+
+        int totalCalls = 0;
+
+        for (const bool engine : { false, true })
+        {
+            const char* pass = engine ? "engine" : "default";
+
+            clear();
+            int numBlocks = 0;
+            const int blocksWithRecords = runPass(engine, seconds, blockSize, sampleRate, numBlocks);
+
+            Array<int> distinct;
+            Array<int> counts;
+            for (int i = 0; i < getNumRecords(); ++i)
+            {
+                int found = -1;
+                for (int j = 0; j < distinct.size() && found < 0; ++j)
+                    if (sameStack(getRecord(distinct[j]), getRecord(i)))
+                        found = j;
+
+                if (found < 0)
+                {
+                    distinct.add(i);
+                    counts.add(1);
+                }
+                else
+                {
+                    counts.getReference(found)++;
+                }
+            }
+
+            for (int j = 0; j < distinct.size(); ++j)
+            {
+                const auto& record = getRecord(distinct[j]);
+                csv << pass << "," << record.call << "," << counts[j] << ",\"" << symbolise(record).joinIntoString(" <- ") << "\"" << newLine;
+            }
+
+            const int numCalls = getNumRecords() + getNumDropped();
+            totalCalls += numCalls;
+            std::cerr << pass << ": " << numCalls << " allocations or locks in " << blocksWithRecords << " of " << numBlocks
+                      << " blocks, " << distinct.size() << " distinct stacks" << std::endl;
+        }
+
+        if (!coversMallocAndLocks())
+            std::cerr << "only operator new and delete are checked on this platform, and only on the calling thread" << std::endl;
+
+        if (!writeReport(args, csv))
+            return 1;
+
+        return totalCalls > 0 ? 1 : 0;
+    }
+}
+
+//==============================================================================
+#if JUCE_LINUX
+
+extern "C"
+{
+    void* malloc(size_t size)
+    {
+        RealtimeCheck::record("malloc");
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        RealtimeCheck::record("calloc");
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        RealtimeCheck::record("realloc");
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void* pointer)
+    {
+        if (pointer != nullptr)
+            RealtimeCheck::record("free");
+        __libc_free(pointer);
+    }
+
+    // the voices and their arenas ask for memory aligned on cache lines
+    int posix_memalign(void** result, size_t alignment, size_t size)
+    {
+        RealtimeCheck::record("posix_memalign");
+
+        if (alignment % sizeof(void*) != 0 || !isPowerOfTwo(alignment))
+            return EINVAL;
+
+        auto* pointer = __libc_memalign(alignment, size);
+        if (pointer == nullptr)
+            return ENOMEM;
+
+        *result = pointer;
+        return 0;
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        RealtimeCheck::record("aligned_alloc");
+        return __libc_memalign(alignment, size);
+    }
+
+    void* memalign(size_t alignment, size_t size)
+    {
+        RealtimeCheck::record("memalign");
+        return __libc_memalign(alignment, size);
+    }
+
+    // resolved on first use, without a function-local static: its guard may itself lock. The
+    // condition functions have two versions in glibc, dlsym() may give the old one
+    static void* resolveNext(std::atomic<void*>& real, const char* name, const char* version = nullptr)
+    {
+        auto* function = real.load(std::memory_order_relaxed);
+        if (function == nullptr)
+        {
+            if (version != nullptr)
+                function = dlvsym(RTLD_NEXT, name, version);
+            if (function == nullptr)
+                function = dlsym(RTLD_NEXT, name);
+            real.store(function, std::memory_order_relaxed);
+        }
+
+        return function;
+    }
+
+    static const char* const condVersion = "GLIBC_2.3.2";
+
+    static std::atomic<void*> realMutexLock { nullptr };
+    static std::atomic<void*> realMutexTrylock { nullptr };
+    static std::atomic<void*> realCondWait { nullptr };
+    static std::atomic<void*> realCondTimedwait { nullptr };
+    static std::atomic<void*> realCondSignal { nullptr };
+    static std::atomic<void*> realCondBroadcast { nullptr };
+    static std::atomic<void*> realCondClockwait { nullptr };
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        RealtimeCheck::record("pthread_mutex_lock");
+        return ((int (*)(pthread_mutex_t*))resolveNext(realMutexLock, "pthread_mutex_lock"))(mutex);
+    }
+
+    int pthread_mutex_trylock(pthread_mutex_t* mutex)
+    {
+        RealtimeCheck::record("pthread_mutex_trylock");
+        return ((int (*)(pthread_mutex_t*))resolveNext(realMutexTrylock, "pthread_mutex_trylock"))(mutex);
+    }
+
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        RealtimeCheck::record("pthread_cond_wait");
+        return ((int (*)(pthread_cond_t*, pthread_mutex_t*))resolveNext(realCondWait, "pthread_cond_wait", condVersion))(condition, mutex);
+    }
+
+    int pthread_cond_timedwait(pthread_cond_t* condition, pthread_mutex_t* mutex, const timespec* deadline)
+    {
+        RealtimeCheck::record("pthread_cond_timedwait");
+        return ((int (*)(pthread_cond_t*, pthread_mutex_t*, const timespec*))resolveNext(realCondTimedwait, "pthread_cond_timedwait", condVersion))(condition, mutex, deadline);
+    }
+
+    int pthread_cond_signal(pthread_cond_t* condition)
+    {
+        RealtimeCheck::record("pthread_cond_signal");
+        return ((int (*)(pthread_cond_t*))resolveNext(realCondSignal, "pthread_cond_signal", condVersion))(condition);
+    }
+
+    int pthread_cond_broadcast(pthread_cond_t* condition)
+    {
+        RealtimeCheck::record("pthread_cond_broadcast");
+        return ((int (*)(pthread_cond_t*))resolveNext(realCondBroadcast, "pthread_cond_broadcast", condVersion))(condition);
+    }
+
+   #if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30)
+    // what the timed waits of std::condition_variable call
+    int pthread_cond_clockwait(pthread_cond_t* condition, pthread_mutex_t* mutex, clockid_t clock, const timespec* deadline)
+    {
+        RealtimeCheck::record("pthread_cond_clockwait");
+        return ((int (*)(pthread_cond_t*, pthread_mutex_t*, clockid_t, const timespec*))resolveNext(realCondClockwait, "pthread_cond_clockwait"))(condition, mutex, clock, deadline);
+    }
+   #endif
+}
+
+#else
+
+void* operator new(size_t size)
+{
+    RealtimeCheck::record("operator new");
+    if (auto* pointer = std::malloc(size == 0 ? 1 : size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    RealtimeCheck::record("operator new[]");
+    if (auto* pointer = std::malloc(size == 0 ? 1 : size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    if (pointer != nullptr)
+        RealtimeCheck::record("operator delete");
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    if (pointer != nullptr)
+        RealtimeCheck::record("operator delete[]");
+    std::free(pointer);
+}
+
+#endif
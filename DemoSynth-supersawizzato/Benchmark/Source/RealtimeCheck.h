@@ -0,0 +1,17 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Real-time safety check: the processor is driven like a host would, with dense MIDI and parameter
+// automation, and every allocation or lock made inside processBlock is recorded with its stack
+// (see RealtimeCheck.cpp for what is interposed on each platform). Automation is applied between
+// blocks, then the processor's listener is called again for it on the armed thread, as hosts that
+// automate on the audio thread do. Every parameter is automated, the engine ones (voices, threads,
+// render-ahead) included. A first pass starts from the defaults; a second one sets the engine
+// parameters before prepareToPlay, renders in parallel and ahead, switches render-ahead off and
+// on, and also watches the plug-in's render threads.
+namespace RealtimeCheck
+{
+    // --rtcheck [--seconds <s>] [--block <samples>] [--csv <file>]
+    // returns 1 when anything was recorded
+    int run(const ArgumentList& args);
+}
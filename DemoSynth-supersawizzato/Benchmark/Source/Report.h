@@ -0,0 +1,22 @@
+#pragma once
+#include <JuceHeader.h>
+
+// the CSV goes to the file given with --csv, or to the standard output
+static bool writeReport(const ArgumentList& args, const String& csv)
+{
+    if (!args.containsOption("--csv"))
+    {
+        std::cout << csv;
+        return true;
+    }
+
+    const auto file = args.getFileForOption("--csv");
+
+    if (!file.replaceWithText(csv))
+    {
+        std::cerr << "Cannot write " << file.getFullPathName() << std::endl;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <JuceHeader.h>
+#include "../../Source/Synth.h"
+#include "Report.h"
+
+// Memory report of the shared DSP tables: the voices of a number of instances of the plug-in are
+// created and prepared as the processors would, then every table in the cache is listed with its
+// users and its size, next to what the same tables would take if every user built its own.
+namespace ResourceReport
+{
+    // --resources [--instances <n>] [--rate <Hz>] [--csv <file>]
+    static int run(const ArgumentList& args)
+    {
+        const int numInstances = args.containsOption("--instances") ? jlimit(1, 1000, args.getValueForOption("--instances").getIntValue()) : 30;
+        const double sampleRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 48000.0;
+
+        // held for the whole run, as the processors do
+        SharedResourcePointer<DspResources::Cache> cache;
+
+        OwnedArray<SimpleSynthVoice> voices;
+        for (int i = 0; i < numInstances * Parameters::defaultVoices; ++i)
+        {
+            auto* voice = voices.add(new SimpleSynthVoice());
+            voice->prepareToPlay(sampleRate, RENDER_CHUNK_SIZE);
+        }
+
+        String csv = "type,sample_rate,quality,frequency,users,bytes,unshared_bytes";
+        csv << newLine;
+
+        size_t sharedBytes = 0;
+        size_t unsharedBytes = 0;
+        for (auto& usage : cache->getUsage())
+        {
+            const size_t unshared = usage.bytes * (size_t)usage.users;
+            sharedBytes += usage.bytes;
+            unsharedBytes += unshared;
+
+            csv << DspResources::typeNames[usage.key.type] << "," << usage.key.sampleRate << "," << usage.key.quality << ","
+                << usage.key.frequency << "," << usage.users << "," << (int64)usage.bytes << "," << (int64)unshared << newLine;
+        }
+
+        std::cerr << numInstances << " instances, " << voices.size() << " voices: " << (int64)sharedBytes
+                  << " bytes of tables, " << (int64)unsharedBytes << " if each user had its own" << std::endl;
+
+        return writeReport(args, csv) ? 0 : 1;
+    }
+}
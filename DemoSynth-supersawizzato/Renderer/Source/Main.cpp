@@ -0,0 +1,376 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Supercore batch renderer: plays Standard MIDI Files through the plug-in's
+    own processor, with a saved plug-in state, and writes WAV or FLAC files.
+    The processor is rendered as a host bounces it, offline, one file per
+    worker thread, as fast as the machine allows.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+
+namespace
+{
+    struct Options
+    {
+        File state;                 // XML from getStateInformation, or the binary state itself
+        File outputFolder;          // next to each MIDI file when not set
+        double sampleRate = 48000.0;
+        int blockSize = 512;
+        int bitDepth = 24;
+        bool flac = false;
+        double tailSeconds = 3.0;   // rendered after the last MIDI event, for the releases
+    };
+
+    // what a host would report while playing the file from its start, at the file's first tempo
+    class FilePlayHead : public AudioPlayHead
+    {
+    public:
+        FilePlayHead(double rate, double tempo, int numerator, int denominator)
+            : sampleRate(rate), bpm(tempo), timeSigNumerator(numerator), timeSigDenominator(denominator) {}
+
+        void setTimeInSamples(const int64 newTime)
+        {
+            timeInSamples = newTime;
+        }
+
+        Optional<PositionInfo> getPosition() const override
+        {
+            const double seconds = timeInSamples / sampleRate;
+            const double ppq = seconds * bpm / 60.0;
+            const double ppqPerBar = timeSigNumerator * 4.0 / timeSigDenominator;
+
+            PositionInfo info;
+            info.setIsPlaying(true);
+            info.setBpm(bpm);
+            info.setTimeSignature(TimeSignature { timeSigNumerator, timeSigDenominator });
+            info.setTimeInSamples(timeInSamples);
+            info.setTimeInSeconds(seconds);
+            info.setPpqPosition(ppq);
+            info.setPpqPositionOfLastBarStart(std::floor(ppq / ppqPerBar) * ppqPerBar);
+            return info;
+        }
+
+    private:
+        const double sampleRate;
+        const double bpm;
+        const int timeSigNumerator;
+        const int timeSigDenominator;
+        int64 timeInSamples = 0;
+    };
+
+    //==============================================================================
+    // every track in one sequence, in seconds; the tempo and time signature are the first ones of the file
+    bool readMidiFile(const File& file, MidiMessageSequence& sequence, double& bpm, int& numerator, int& denominator)
+    {
+        FileInputStream stream(file);
+        MidiFile midiFile;
+
+        if (!stream.openedOk() || !midiFile.readFrom(stream))
+            return false;
+
+        MidiMessageSequence tempoEvents;
+        midiFile.findAllTempoEvents(tempoEvents);
+        bpm = tempoEvents.getNumEvents() > 0 ? 60.0 / tempoEvents.getEventPointer(0)->message.getTempoSecondsPerQuarterNote() : 120.0;
+
+        MidiMessageSequence timeSigEvents;
+        midiFile.findAllTimeSigEvents(timeSigEvents);
+        numerator = 4;
+        denominator = 4;
+        if (timeSigEvents.getNumEvents() > 0)
+            timeSigEvents.getEventPointer(0)->message.getTimeSignatureInfo(numerator, denominator);
+
+        midiFile.convertTimestampTicksToSeconds();
+
+        for (int track = 0; track < midiFile.getNumTracks(); ++track)
+            sequence.addSequence(*midiFile.getTrack(track), 0.0);
+
+        sequence.updateMatchedPairs();
+        return true;
+    }
+
+    std::unique_ptr<AudioFormatWriter> createWriter(const File& file, const Options& options)
+    {
+        file.deleteFile();
+        std::unique_ptr<FileOutputStream> stream(file.createOutputStream());
+
+        if (stream == nullptr)
+            return nullptr;
+
+        std::unique_ptr<AudioFormat> format;
+        if (options.flac)
+            format.reset(new FlacAudioFormat());
+        else
+            format.reset(new WavAudioFormat());
+
+        std::unique_ptr<AudioFormatWriter> writer(format->createWriterFor(stream.get(), options.sampleRate, 2, options.bitDepth, {}, 0));
+
+        if (writer != nullptr)
+            stream.release();   // owned by the writer now
+
+        return writer;
+    }
+
+    // the state as setStateInformation wants it, from its XML or from the binary state; the bounce
+    // profile of the state decides whether the voices are rendered in parallel only when the files
+    // themselves are not
+    bool loadState(const Options& options, const bool parallelVoices, MemoryBlock& state)
+    {
+        auto xml = parseXML(options.state);
+
+        if (xml == nullptr)
+        {
+            MemoryBlock data;
+            if (options.state.loadFileAsData(data) && data.getSize() > 0)
+                xml = AudioProcessor::getXmlFromBinary(data.getData(), (int)data.getSize());
+        }
+
+        if (xml == nullptr)
+            return false;
+
+        if (!parallelVoices)
+            xml->setAttribute(Parameters::BounceProfile::parallelId(), 0);
+
+        AudioProcessor::copyXmlToBinary(*xml, state);
+        return true;
+    }
+
+    struct Result
+    {
+        bool ok = false;
+        String error;
+        double audioSeconds = 0.0;
+        double renderSeconds = 0.0;
+    };
+
+    //==============================================================================
+    // the plug-in's processor, unchanged, bounced offline from the first event to the end of the tail
+    Result renderFile(const File& midiFile, const File& outputFile, const MemoryBlock& state, const Options& options)
+    {
+        Result result;
+        const int64 start = Time::getHighResolutionTicks();
+
+        MidiMessageSequence sequence;
+        double bpm;
+        int numerator, denominator;
+        if (!readMidiFile(midiFile, sequence, bpm, numerator, denominator))
+        {
+            result.error = "cannot read " + midiFile.getFullPathName();
+            return result;
+        }
+
+        auto writer = createWriter(outputFile, options);
+        if (writer == nullptr)
+        {
+            result.error = "cannot write " + outputFile.getFullPathName();
+            return result;
+        }
+
+        DemoSynthAudioProcessor processor;
+        FilePlayHead playHead(options.sampleRate, bpm, numerator, denominator);
+        processor.setPlayHead(&playHead);
+        processor.setStateInformation(state.getData(), (int)state.getSize());
+        processor.setPlayConfigDetails(0, 2, options.sampleRate, options.blockSize);
+        processor.setNonRealtime(true);
+        processor.prepareToPlay(options.sampleRate, options.blockSize);
+
+        const double lastEvent = sequence.getNumEvents() > 0 ? sequence.getEndTime() : 0.0;
+        const int64 totalSamples = (int64)std::ceil((lastEvent + options.tailSeconds) * options.sampleRate);
+
+        AudioBuffer<float> buffer(2, options.blockSize);
+        MidiBuffer midi;
+        midi.ensureSize(4096);
+        int nextEvent = 0;
+
+        for (int64 position = 0; position < totalSamples; position += options.blockSize)
+        {
+            const int numSamples = (int)jmin((int64)options.blockSize, totalSamples - position);
+            const double blockEnd = (position + numSamples) / options.sampleRate;
+
+            midi.clear();
+            for (; nextEvent < sequence.getNumEvents(); ++nextEvent)
+            {
+                const auto& message = sequence.getEventPointer(nextEvent)->message;
+                if (message.getTimeStamp() >= blockEnd)
+                    break;
+
+                if (!message.isMetaEvent())
+                {
+                    const int64 sample = (int64)(message.getTimeStamp() * options.sampleRate);
+                    midi.addEvent(message, (int)jlimit((int64)0, (int64)numSamples - 1, sample - position));
+                }
+            }
+
+            playHead.setTimeInSamples(position);
+            AudioBuffer<float> block(buffer.getArrayOfWritePointers(), 2, numSamples);
+            processor.processBlock(block, midi);
+
+            if (!writer->writeFromAudioSampleBuffer(block, 0, numSamples))
+            {
+                result.error = "cannot write " + outputFile.getFullPathName();
+                return result;
+            }
+        }
+
+        processor.releaseResources();
+        processor.setPlayHead(nullptr);
+        writer.reset();
+
+        result.ok = true;
+        result.audioSeconds = totalSamples / options.sampleRate;
+        result.renderSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+        return result;
+    }
+
+    //==============================================================================
+    // options followed by a value; every other argument that is not an option is a MIDI file
+    const StringArray valueOptions { "--state", "--out", "--rate", "--block", "--bits", "--threads", "--tail" };
+
+    Array<File> getMidiFiles(const ArgumentList& args)
+    {
+        Array<File> files;
+
+        for (int i = 0; i < args.size(); ++i)
+        {
+            const auto& argument = args[i];
+
+            if (argument.isOption())
+            {
+                if (valueOptions.contains(argument.text) && !argument.text.containsChar('='))
+                    ++i;
+                continue;
+            }
+
+            const auto file = argument.resolveAsFile();
+            if (file.isDirectory())
+                files.addArray(file.findChildFiles(File::findFiles, false, "*.mid;*.midi"));
+            else
+                files.add(file);
+        }
+
+        return files;
+    }
+
+    void printUsage()
+    {
+        std::cout << "SupercoreRender --state <preset.xml> [--out <folder>] [--flac] [--bits <16|24|32>] [--rate <Hz>]" << std::endl
+                  << "                [--block <samples>] [--threads <n>] [--tail <s>] <file.mid | folder>..." << std::endl
+                  << "  --state    the plug-in state, as saved by the plug-in (XML or binary)" << std::endl
+                  << "  --out      folder of the renders, next to each MIDI file by default" << std::endl
+                  << "  --flac     FLAC instead of WAV (16 or 24 bit)" << std::endl
+                  << "  --bits     24 by default, 32 is floating point WAV" << std::endl
+                  << "  --rate     48000 by default" << std::endl
+                  << "  --block    block size given to the processor, 512 by default" << std::endl
+                  << "  --threads  files rendered at once, one per core by default" << std::endl
+                  << "  --tail     seconds rendered after the last MIDI event, 3 by default" << std::endl;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h") || !args.containsOption("--state"))
+    {
+        printUsage();
+        return args.containsOption("--help|-h") ? 0 : 1;
+    }
+
+    // the parameters of the processor need a message manager
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    Options options;
+    options.state = args.getFileForOption("--state");
+    options.flac = args.containsOption("--flac");
+    if (args.containsOption("--out"))
+        options.outputFolder = args.getFileForOption("--out");
+    if (args.containsOption("--rate"))
+        options.sampleRate = jlimit(8000.0, 384000.0, args.getValueForOption("--rate").getDoubleValue());
+    if (args.containsOption("--block"))
+        options.blockSize = jlimit(16, 8192, args.getValueForOption("--block").getIntValue());
+    if (args.containsOption("--bits"))
+        options.bitDepth = args.getValueForOption("--bits").getIntValue();
+    if (args.containsOption("--tail"))
+        options.tailSeconds = jmax(0.0, args.getValueForOption("--tail").getDoubleValue());
+
+    if (options.flac ? (options.bitDepth != 16 && options.bitDepth != 24)
+                     : (options.bitDepth != 16 && options.bitDepth != 24 && options.bitDepth != 32))
+    {
+        std::cerr << options.bitDepth << " bit is not supported for " << (options.flac ? "FLAC" : "WAV") << std::endl;
+        return 1;
+    }
+
+    const auto midiFiles = getMidiFiles(args);
+    if (midiFiles.isEmpty())
+    {
+        std::cerr << "No MIDI files to render" << std::endl;
+        return 1;
+    }
+
+    const int numThreads = jlimit(1, midiFiles.size(), args.containsOption("--threads") ? args.getValueForOption("--threads").getIntValue()
+                                                                                       : SystemStats::getNumCpus());
+
+    // with several files at once every core is busy already, and the voices of each are rendered serially
+    MemoryBlock state;
+    if (!loadState(options, numThreads == 1, state))
+    {
+        std::cerr << "Cannot read the state " << options.state.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    if (options.outputFolder != File())
+        options.outputFolder.createDirectory();
+
+    CriticalSection reportLock;
+    int numDone = 0;
+    int numFailed = 0;
+    double totalAudioSeconds = 0.0;
+    const int64 start = Time::getHighResolutionTicks();
+
+    {
+        ThreadPool pool(numThreads);
+
+        for (const auto& midiFile : midiFiles)
+        {
+            pool.addJob([&, midiFile]
+            {
+                const auto folder = options.outputFolder != File() ? options.outputFolder : midiFile.getParentDirectory();
+                const auto outputFile = folder.getChildFile(midiFile.getFileNameWithoutExtension() + (options.flac ? ".flac" : ".wav"));
+
+                const auto result = renderFile(midiFile, outputFile, state, options);
+
+                const ScopedLock sl(reportLock);
+                ++numDone;
+                std::cerr << "[" << numDone << "/" << midiFiles.size() << "] ";
+
+                if (result.ok)
+                {
+                    totalAudioSeconds += result.audioSeconds;
+                    std::cerr << outputFile.getFileName() << ": " << String(result.audioSeconds, 1) << " s in "
+                              << String(result.renderSeconds, 2) << " s, "
+                              << String(result.audioSeconds / jmax(1.0e-6, result.renderSeconds), 1) << "x real time" << std::endl;
+                }
+                else
+                {
+                    ++numFailed;
+                    std::cerr << result.error << std::endl;
+                }
+            });
+        }
+
+        while (pool.getNumJobs() > 0)
+            Thread::sleep(50);
+    }
+
+    const double elapsed = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+    std::cerr << (midiFiles.size() - numFailed) << " files, " << String(totalAudioSeconds, 1) << " s of audio in "
+              << String(elapsed, 2) << " s, " << String(totalAudioSeconds / jmax(1.0e-6, elapsed), 1) << "x real time"
+              << std::endl;
+
+    return numFailed > 0 ? 1 : 0;
+}
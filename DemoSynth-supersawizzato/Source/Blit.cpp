@@ -10,6 +10,15 @@
 
 #include "Blit.h"
 
+// built once, then shared by every oscillator of every voice
+struct Blit::SharedTable : public DspResources::Resource
+{
+    SharedTable() { populateBlitTab(values); }
+    double values[BLIT_TABLE_SIZE][BLIT_TAPS];
+};
+
+static const DspResources::Key sharedTableKey { DspResources::blitTable, 0.0, BLIT_TABLE_SIZE, 0.0 };
+
 void Blit::prepareToPlay(const dsp::ProcessSpec spec) {
     this->sr = spec.sampleRate;
     sp = 1.0 / sr;
@@ -17,16 +26,25 @@ void Blit::prepareToPlay(const dsp::ProcessSpec spec) {
 
     alpha = exp(-(LEAKY_INTEGRATOR_BASE_FREQUENCY / sr) * MathConstants<double>::twoPi);
 
-    populateBlitTab();
+    if (blitTable == nullptr)
+        blitTable = DspResources::get<SharedTable>(sharedTableKey, sizeof(SharedTable), [] { return new SharedTable(); });
+
+    blitsMatrix = static_cast<SharedTable*>(blitTable.get())->values;
+}
+
+void Blit::prefetchSharedTable()
+{
+    DspResources::prefetch<SharedTable>(sharedTableKey, sizeof(SharedTable), [] { return new SharedTable(); });
 }
 
-void Blit::populateBlitTab()
+void Blit::populateBlitTab(double blitsMatrix[][BLIT_TAPS])
 {
+    const double mpi = MathConstants<double>::pi;
     double step = 0.001; // 1/1000
     double temp = 0.0;
     double totalSum = 0.0;
 
-    for (int i = 0; i < 1000; i++) {
+    for (int i = 0; i < BLIT_TABLE_SIZE; i++) {
         totalSum = 0.0;
         temp = step * i;
 
@@ -69,6 +87,18 @@ void Blit::clearAccumulator() {
 //    passedNeg = false;
 }
 
+// back to the state of a new oscillator, the BLITs still to be played included
+void Blit::reset()
+{
+    clearAccumulator();
+    std::fill(std::begin(pBlit), std::end(pBlit), 0.0);
+    std::fill(std::begin(nBlit), std::end(nBlit), 0.0);
+    index = 0;
+    subOff1 = 0.0;
+    subOff2 = 0.0;
+    passedNeg = false;
+}
+
 float Blit::updateWaveform(double f, int waveform)
 {
     float tempSample = 0.0f;
@@ -107,6 +137,143 @@ float Blit::updateWaveform(double f, int waveform)
     return tempSample;
 }
 
+// Advances the oscillator by numSamples without generating them: the edges are counted with the
+// same rounding as the update methods, so when it is rendered again it is in phase. The BLITs of
+// the edges in the last BLIT_TAPS samples are fired as usual, since the part of them not played yet
+// is still to come. The integrators are then set to the waveform at the phase reached, as if they
+// had kept running: coming back does not start from the values they had before the silence, which
+// would take the leak (~20 ms) to settle and would be heard as a thump.
+void Blit::skip(double f, int numSamples, int waveform)
+{
+    decrementStep = f * sp;
+    const double period = sr / f;
+    const bool sawUp = waveform == 3;
+    const bool hasNegativeEdge = waveform != 0 && waveform != 3;
+    // part of the period the squares are low, as in their update methods
+    const double weight = waveform == 5 ? 0.35 : (waveform == 6 ? 0.2 : 0.5);
+    // the upward saw counts its period on the negative edge
+    double& periodOffset = sawUp ? subOff2 : subOff1;
+
+    const unsigned char first = index;
+    for (int i = 0; i < jmin(numSamples, 256); ++i)
+        pBlit[(unsigned char)(first + i)] = nBlit[(unsigned char)(first + i)] = 0.0;
+
+    int position = 0;
+    while (position < numSamples)
+    {
+        const bool fires = position >= numSamples - BLIT_TAPS;
+        index = (unsigned char)(first + position);
+
+        const double edge = period + periodOffset;
+        const bool periodEdge = sampleCont >= int(edge);
+        if (periodEdge)
+        {
+            if (sawUp)
+            {
+                nEdge = edge;
+                if (fires) getNegativeBlit();
+                else subOff2 = edge - int(edge);
+            }
+            else
+            {
+                pEdge = edge;
+                if (fires) getPositiveBlit();
+                else subOff1 = edge - int(edge);
+            }
+            passedNeg = false;
+            sampleCont = 0;
+        }
+
+        bool negativeEdge = false;
+        if (hasNegativeEdge && !periodEdge)
+        {
+            nEdge = period * (1.0 - weight) + subOff1;
+            negativeEdge = crossingNegEdge();
+            if (negativeEdge)
+            {
+                if (fires) getNegativeBlit();
+                else subOff2 = nEdge - int(nEdge);
+            }
+        }
+
+        if (periodEdge || negativeEdge)
+        {
+            ++sampleCont;
+            ++position;
+            continue;
+        }
+
+        // no edge before the next one: the samples in between are only counted
+        int next = int(period + periodOffset);
+        if (hasNegativeEdge && !passedNeg)
+            next = jmin(next, int(nEdge));
+
+        const int step = jmin(numSamples - position, jmax(1, next - sampleCont));
+        sampleCont += step;
+        position += step;
+    }
+
+    // the samples of the fired BLITs that fall in the skipped span are not played
+    for (int i = jmax(0, numSamples - BLIT_TAPS); i < numSamples; ++i)
+        pBlit[(unsigned char)(first + i)] = nBlit[(unsigned char)(first + i)] = 0.0;
+    index = (unsigned char)(first + numSamples);
+
+    // what the integrators have still to receive from the edges already fired
+    double pendingPositive = 0.0;
+    double pendingNegative = 0.0;
+    for (int i = 0; i < BLIT_TAPS; ++i)
+    {
+        pendingPositive += pBlit[(unsigned char)(index + i)];
+        pendingNegative += nBlit[(unsigned char)(index + i)];
+    }
+
+    // where the integrators settle for this frequency, from the middle of the last BLIT fired, which
+    // is BLIT_TAPS / 2 samples after its edge plus the fraction of the edge. The waveforms leak
+    // back from their jumps, so their shape is worked out with the leak, in closed form.
+    const double decay = alpha - leakiness;
+    const double decayPeriod = std::pow(decay, period);
+    double sinceJump = sampleCont - BLIT_TAPS / 2 - (sawUp ? subOff2 : subOff1);
+    const bool jumpNotReached = sinceJump < 0.0;
+    while (sinceJump < 0.0)
+        sinceJump += period;
+    const double decayJump = std::pow(decay, sinceJump);
+
+    if (!hasNegativeEdge || waveform == 1)
+    {
+        // each jump decays on top of the ramp, which settles at decrementStep * decay / (1 - decay)
+        const double saw = decayJump / (1.0 - decayPeriod) - decrementStep * decay / (1.0 - decay);
+        // the last jump counts for the part of its BLIT received so far
+        const double received = (jumpNotReached ? 1.0 : 0.0) - (sawUp ? -pendingNegative : pendingPositive);
+        accSaw = sawUp ? -saw - received : saw + received;
+    }
+
+    if (hasNegativeEdge)
+    {
+        // high from the positive jump to the negative one, then low
+        const double high = (1.0 - weight) * period;
+        const double decayHigh = std::pow(decay, high);
+        const double top = (1.0 - std::pow(decay, period - high)) / (1.0 - decayPeriod);
+        const double bottom = top * decayHigh - 1.0;
+        const bool isHigh = sinceJump < high;
+        const double square = isHigh ? top * decayJump : bottom * std::pow(decay, sinceJump - high);
+
+        // the same correction for the jumps not fully received, on the waveform without leak
+        const double withoutLeak = weight - (passedNeg ? 1.0 : 0.0) - pendingPositive - pendingNegative;
+        accSquare = square + withoutLeak - (isHigh ? weight : weight - 1.0);
+
+        if (waveform == 1 || waveform == 2)
+        {
+            // integral of the square above, with the same leak (leakinessTri == leakiness)
+            const double slope = 8.0 * decrementStep;
+            const double low = period - high;
+            const double start = slope * std::pow(decay, low) * (top * decayHigh * high + bottom * low) / (1.0 - decayPeriod);
+            const double peak = decayHigh * (start + slope * top * high);
+            accTri = isHigh ? decayJump * (start + slope * top * sinceJump)
+                            : std::pow(decay, sinceJump - high) * (peak + slope * bottom * (sinceJump - high));
+        }
+    }
+}
+
 float Blit::updateTriangle(double f) {
     accTri = accTri * (alpha - leakinessTri) + updateSquare(f) * 8.0 * f * sp;
     return accTri;
@@ -10,8 +10,11 @@
 
 #pragma once
 #include <JuceHeader.h>
+#include "DspResources.h"
 
 #define LEAKY_INTEGRATOR_BASE_FREQUENCY        8.0
+#define BLIT_TABLE_SIZE                        1000
+#define BLIT_TAPS                              32
 
 class Blit {
 public:
@@ -19,8 +22,13 @@ public:
     ~Blit() {}
     void prepareToPlay(const dsp::ProcessSpec spec);
     float updateWaveform(double frequencySample, int waveform);
+    void skip(double frequencySample, int numSamples, int waveform);
     void setBlitPhase(const int phaseDegree, const double frequency);
     void clearAccumulator();
+    void reset();
+
+    // starts building the shared table in the background, ahead of the first prepareToPlay
+    static void prefetchSharedTable();
 
 private:
     int maxBlock;
@@ -44,17 +52,18 @@ private:
     double decrementStep = 0.0;
     double offset = 0.0;
     
-    double mpi = MathConstants<double>::pi;
-
     int sampleCont = 0;
     bool passedNeg = false;
     unsigned char index = 0;
 
     double pBlit[256] = { 0 };
     double nBlit[256] = { 0 };
-    double blitsMatrix[1000][32] = { 0 };
+    // windowed sinc table shared by all the Blits (it does not depend on the sample rate)
+    struct SharedTable;
+    DspResources::Resource::Ptr blitTable;
+    const double (*blitsMatrix)[BLIT_TAPS] = nullptr;
     
-    void populateBlitTab();
+    static void populateBlitTab(double table[][BLIT_TAPS]);
     void getNegativeBlit();
     void getPositiveBlit();
 
@@ -0,0 +1,82 @@
+#pragma once
+#include <JuceHeader.h>
+#include "Profiling.h"
+
+// CPU panel of SUPERCORE_PROFILING builds: load, worst block against its deadline, active voices,
+// the share of each voice stage and the histogram of the ladder's Newton iterations
+class CpuPanel : public Component, private Timer
+{
+public:
+    CpuPanel(Profiling::Profiler& p) : profiler(p)
+    {
+        startTimerHz(10);
+    }
+
+    ~CpuPanel() override
+    {
+        stopTimer();
+    }
+
+    void paint(Graphics& g) override
+    {
+        const auto accent = Colour(0xFFc67856);
+        const auto text = Colour(0xFFf0f1f1);
+
+        g.setColour(Colour(0xFF1C2531));
+        g.fillRoundedRectangle(getLocalBounds().toFloat(), 10.0f);
+
+        g.setFont(Font("Futura", 16.0f, Font::bold));
+        g.setColour(accent);
+        g.drawText("CPU", 10, 5, 100, 20, Justification::left);
+
+        g.setFont(Font("Lato", 12.0f, Font::plain));
+        g.setColour(text);
+        g.drawText("Load " + String(roundToInt(snapshot.load * 100.0f)) + "%", 10, 26, 70, 14, Justification::left);
+        g.drawText("Voices " + String(snapshot.activeVoices), 70, 26, 60, 14, Justification::right);
+
+        // late blocks are drawn in the accent colour
+        if (snapshot.worstBlockMs > snapshot.worstDeadlineMs)
+            g.setColour(accent);
+        g.drawText("Worst " + String(snapshot.worstBlockMs, 2) + " / " + String(snapshot.worstDeadlineMs, 2) + " ms",
+                   10, 40, 120, 14, Justification::left);
+
+        // stages
+        g.setFont(Font("Lato", 11.0f, Font::plain));
+        for (int stage = 0; stage < Profiling::numStages; ++stage)
+        {
+            const int y = 58 + stage * 11;
+            g.setColour(text);
+            g.drawText(Profiling::stageNames[stage], 10, y, 40, 11, Justification::left);
+            g.setColour(accent);
+            g.fillRect(52.0f, y + 2.0f, 78.0f * snapshot.stageShare[stage], 7.0f);
+        }
+
+        // Newton iterations, 0 on the left, solves stopped by the cap on the right
+        g.setColour(text);
+        g.drawText("Newton its", 10, 148, 120, 12, Justification::left);
+
+        uint32 mostSamples = 1;
+        for (auto count : snapshot.newtonIterations)
+            mostSamples = jmax(mostSamples, count);
+
+        const float binWidth = 120.0f / Profiling::numNewtonBins;
+        g.setColour(accent);
+        for (int bin = 0; bin < Profiling::numNewtonBins; ++bin)
+        {
+            const float height = 28.0f * snapshot.newtonIterations[bin] / mostSamples;
+            g.fillRect(10.0f + bin * binWidth + 1.0f, 190.0f - height, binWidth - 2.0f, height);
+        }
+    }
+
+private:
+    void timerCallback() override
+    {
+        if (profiler.pull(snapshot))
+            repaint();
+    }
+
+    Profiling::Profiler& profiler;
+    Profiling::Snapshot snapshot;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CpuPanel)
+};
@@ -0,0 +1,202 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Immutable DSP tables shared by every voice of every instance of the plug-in in the process,
+// keyed by (type, sample rate, quality). The cache lives as long as something holds a
+// SharedResourcePointer<DspResources::Cache>: every processor does, so all the instances in a
+// host share the same tables. Without a holder resources are built for each user, not shared.
+// Lookups lock, they are made when voices are created and prepared, never while rendering.
+// Tables known in advance can be prefetched: they are built on the cache's own thread and a
+// lookup made meanwhile waits for them rather than building them a second time.
+namespace DspResources
+{
+    enum Type
+    {
+        blitTable = 0, tanhTable, firLowpass,
+        numTypes
+    };
+
+    static const char* const typeNames[numTypes] = { "blit", "tanh", "fir_lowpass" };
+
+    struct Key
+    {
+        int type;
+        double sampleRate;  // 0 for tables that do not depend on it
+        int quality;        // table size or filter order
+        double frequency;   // cutoff of the filters, 0 otherwise
+
+        bool operator== (const Key& other) const
+        {
+            return type == other.type && sampleRate == other.sampleRate
+                && quality == other.quality && frequency == other.frequency;
+        }
+    };
+
+    class Resource : public ReferenceCountedObject
+    {
+    public:
+        typedef ReferenceCountedObjectPtr<Resource> Ptr;
+        virtual ~Resource() {}
+    };
+
+    // a resource in the cache, users not counting the cache itself
+    struct Usage
+    {
+        Key key;
+        int users;
+        size_t bytes;
+    };
+
+    class Cache
+    {
+    public:
+        // the resource for key, made with create() if nobody has it yet
+        template <typename ResourceType, typename Factory>
+        ReferenceCountedObjectPtr<ResourceType> get(const Key& key, const size_t bytes, Factory create)
+        {
+            for (;;)
+            {
+                {
+                    const ScopedLock sl(lock);
+
+                    if (!building.contains(key))
+                    {
+                        removeUnused();
+
+                        if (auto* entry = find(key))
+                        {
+                            entry->prefetched = false;
+                            return static_cast<ResourceType*>(entry->resource.get());
+                        }
+
+                        ReferenceCountedObjectPtr<ResourceType> resource(create());
+                        entries.add({ key, resource.get(), bytes, false });
+                        return resource;
+                    }
+                }
+
+                // being prefetched
+                built.wait(5);
+            }
+        }
+
+        // builds the resource on the cache's thread, without holding the lock; it is kept, unused,
+        // until the first get()
+        template <typename ResourceType, typename Factory>
+        void prefetch(const Key& key, const size_t bytes, Factory create)
+        {
+            {
+                const ScopedLock sl(lock);
+                if (find(key) != nullptr || building.contains(key))
+                    return;
+                building.add(key);
+            }
+
+            builder.addJob([this, key, bytes, create]
+            {
+                Resource::Ptr resource(create());
+
+                const ScopedLock sl(lock);
+                entries.add({ key, resource, bytes, true });
+                building.removeFirstMatchingValue(key);
+                built.signal();
+            });
+        }
+
+        Array<Usage> getUsage()
+        {
+            const ScopedLock sl(lock);
+            removeUnused();
+
+            Array<Usage> usage;
+            for (auto& entry : entries)
+                usage.add({ entry.key, entry.resource->getReferenceCount() - 1, entry.bytes });
+
+            return usage;
+        }
+
+    private:
+        struct Entry
+        {
+            Key key;
+            Resource::Ptr resource;
+            size_t bytes;
+            bool prefetched;    // not claimed by a get() yet
+        };
+
+        Entry* find(const Key& key)
+        {
+            for (auto& entry : entries)
+                if (entry.key == key)
+                    return &entry;
+
+            return nullptr;
+        }
+
+        void removeUnused()
+        {
+            for (int i = entries.size(); --i >= 0;)
+                if (!entries.getReference(i).prefetched && entries.getReference(i).resource->getReferenceCount() == 1)
+                    entries.remove(i);
+        }
+
+        Array<Entry> entries;
+        Array<Key> building;
+        CriticalSection lock;
+        WaitableEvent built;
+
+        // last, so that a build still running is waited for before the entries go
+        ThreadPool builder { 1 };
+    };
+
+    template <typename ResourceType, typename Factory>
+    static ReferenceCountedObjectPtr<ResourceType> get(const Key& key, const size_t bytes, Factory create)
+    {
+        SharedResourcePointer<Cache> cache;
+        return cache->get<ResourceType>(key, bytes, create);
+    }
+
+    template <typename ResourceType, typename Factory>
+    static void prefetch(const Key& key, const size_t bytes, Factory create)
+    {
+        SharedResourcePointer<Cache> cache;
+        cache->prefetch<ResourceType>(key, bytes, create);
+    }
+
+    //==============================================================================
+    // the saturation of the ladder filter and of its Newton-Raphson solver
+    class TanhTable : public Resource
+    {
+    public:
+        typedef ReferenceCountedObjectPtr<TanhTable> Ptr;
+        static const int numPoints = 128;
+
+        const dsp::LookupTableTransform<float> lut { [] (float x) { return std::tanh(x); }, -5.0f, 5.0f, numPoints };
+    };
+
+    static TanhTable::Ptr getTanhTable()
+    {
+        return get<TanhTable>({ tanhTable, 0.0, TanhTable::numPoints, 0.0 }, sizeof(TanhTable) + (TanhTable::numPoints + 1) * sizeof(float),
+                              [] { return new TanhTable(); });
+    }
+
+    // anti-aliasing filter of the oversampled oscillators
+    class FirLowpass : public Resource
+    {
+    public:
+        typedef ReferenceCountedObjectPtr<FirLowpass> Ptr;
+
+        FirLowpass(const double cutoff, const double sampleRate, const int order)
+            : coefficients(dsp::FilterDesign<float>::designFIRLowpassWindowMethod(cutoff, sampleRate, (size_t)order,
+                                                                                  dsp::WindowingFunction<float>::blackman))
+        {}
+
+        const dsp::FIR::Coefficients<float>::Ptr coefficients;
+    };
+
+    static FirLowpass::Ptr getFirLowpass(const double cutoff, const double sampleRate, const int order)
+    {
+        return get<FirLowpass>({ firLowpass, sampleRate, order, cutoff }, sizeof(FirLowpass) + (order + 1) * sizeof(float),
+                               [=] { return new FirLowpass(cutoff, sampleRate, order); });
+    }
+}
@@ -15,29 +15,57 @@ public:
         setCutoff(cutoff);
         update(cutoff);
     };
+    // clears the state of the stages, the settings are kept
+    void reset()
+    {
+        v1 = v2 = v3 = v4 = 0;
+        s1 = s2 = s3 = s4 = 0;
+        for (auto& o : out) o = 0;
+        y = out;
+        jacobianMatrix.reset();
+    }
 //    void process(AudioBuffer<float>& buffer, MyADSR adsr, AudioBuffer<double>& lfo, int startSample, int numSamples, int channel)
-    void process(AudioBuffer<float>& buffer, AudioBuffer<double>& envBuffer, AudioBuffer<double>& lfo, int startSample, int numSamples, int channel)
+    void process(AudioBuffer<float>& buffer, AudioBuffer<double>& envBuffer, AudioBuffer<double>& lfo, int startSample, int numSamples, int channel,
+                 const bool constantModulation = false)
     {
         auto bufferData = buffer.getArrayOfWritePointers();
         auto* envData = envBuffer.getReadPointer(0);
+        auto* lfoData = lfo.getReadPointer(0);
         
         int endSample = startSample + numSamples;
+        
+        // the cutoff does not move in this block: compute the coefficient once
+        if (constantModulation)
+        {
+            update(getModulatedCutoff(envData[startSample], lfoData[startSample]));
+            
+            for (int smp = startSample; smp < endSample ; ++smp)
+                bufferData[channel][smp] = processSample(bufferData[channel][smp]);
+            
+            return;
+        }
+        
         for (int smp = startSample; smp < endSample ; ++smp)
         {
 //            float env = adsr.getNextSampleFilter();
-            float env = envData[smp];
-            float lfoVal = lfo.getSample(0, smp);
-            float envModInSemitones = env * egAmt * maxEnvModSemitones;
-            float lfoModInSemitones = lfoVal * lfoAmt * maxLfoModSemitones;
-            float totalModInSemitones = envModInSemitones + lfoModInSemitones;
-            
-            float modulatedCutoff = cutoff * std::pow(2.0f, totalModInSemitones / 12.0f);
-            modulatedCutoff = juce::jlimit(20.0f, 20000.0f, modulatedCutoff);
-            update(modulatedCutoff);
+            update(getModulatedCutoff(envData[smp], lfoData[smp]));
 
             bufferData[channel][smp] = processSample(bufferData[channel][smp]);
         }
     }
+    
+    // true if neither the EG nor the LFO change the cutoff within the block,
+    // either because their amount is zero or because their output is flat
+    bool hasConstantModulation(AudioBuffer<double>& envBuffer, AudioBuffer<double>& lfo, int startSample, int numSamples) const
+    {
+        const bool envConstant = egAmt == 0.0f
+            || FloatVectorOperations::findMinAndMax(envBuffer.getReadPointer(0, startSample), numSamples).isEmpty();
+        const bool lfoConstant = lfoAmt == 0.0f
+            || FloatVectorOperations::findMinAndMax(lfo.getReadPointer(0, startSample), numSamples).isEmpty();
+        
+        return envConstant && lfoConstant;
+    }
+    
     float processSample(float x)
     {
         y = jacobianMatrix.newtonRaphson(x, s1, s2, s3, s4, k, g);
@@ -71,15 +99,37 @@ public:
     {
         egAmt = newValue;
     }
+    void setMaxNewtonIterations(const int newValue)
+    {
+        jacobianMatrix.setMaxIterations(newValue);
+    }
+#if SUPERCORE_PROFILING
+    void collectNewtonIterations(Profiling::Profiler& profiler)
+    {
+        jacobianMatrix.collectIterations(profiler);
+    }
+#endif
 
 private:
+    float getModulatedCutoff(float env, float lfoVal) const
+    {
+        float envModInSemitones = env * egAmt * maxEnvModSemitones;
+        float lfoModInSemitones = lfoVal * lfoAmt * maxLfoModSemitones;
+        float totalModInSemitones = envModInSemitones + lfoModInSemitones;
+        
+        float modulatedCutoff = cutoff * std::pow(2.0f, totalModInSemitones / 12.0f);
+        return juce::jlimit(20.0f, 20000.0f, modulatedCutoff);
+    }
+    
     void update(float modulatedCutoff)
     {
         g = std::tan(juce::MathConstants<double>::pi * modulatedCutoff / sampleRate);
         g = saturationLUT(g);
     };
 
-    dsp::LookupTableTransform<float> saturationLUT{ [](float x) { return std::tanh(x); }, float(-5), float(5), 128 };
+    // one table for every filter of the process
+    const DspResources::TanhTable::Ptr tanhTable{ DspResources::getTanhTable() };
+    const dsp::LookupTableTransform<float>& saturationLUT{ tanhTable->lut };
     Matrix jacobianMatrix;
     double sampleRate = 44100.0;
     double cutoff = Parameters::defaultFiltHz;
@@ -106,6 +156,11 @@ public:
         filterL.prepareToPlay(sr, 1);
         filterR.prepareToPlay(sr, 1);
     }
+    void reset()
+    {
+        filterL.reset();
+        filterR.reset();
+    }
 //    void process(AudioBuffer<float>& buffer, MyADSR& adsr, float lfoVal, int startSample, int numSamples)
 //    {
 //        float env = adsr.getNextSample();
@@ -115,8 +170,10 @@ public:
 //    void process(AudioBuffer<float>& buffer, MyADSR adsr, AudioBuffer<double>& lfo, int startSample, int numSamples)
     void process(AudioBuffer<float>& buffer, AudioBuffer<double>& envBuffer, AudioBuffer<double>& lfo, int startSample, int numSamples)
     {
-        filterL.process(buffer, envBuffer, lfo, startSample, numSamples, 0);
-        filterR.process(buffer, envBuffer, lfo, startSample, numSamples, 1);
+        // both channels share the same modulation settings
+        const bool constantModulation = filterL.hasConstantModulation(envBuffer, lfo, startSample, numSamples);
+        filterL.process(buffer, envBuffer, lfo, startSample, numSamples, 0, constantModulation);
+        filterR.process(buffer, envBuffer, lfo, startSample, numSamples, 1, constantModulation);
     }
     void setCutoff(const double newCutoffFrequencyHz)
     {
@@ -138,6 +195,18 @@ public:
         filterL.setEnvAmt(newValue);
         filterR.setEnvAmt(newValue);
     }
+    void setMaxNewtonIterations(const int newValue)
+    {
+        filterL.setMaxNewtonIterations(newValue);
+        filterR.setMaxNewtonIterations(newValue);
+    }
+#if SUPERCORE_PROFILING
+    void collectNewtonIterations(Profiling::Profiler& profiler)
+    {
+        filterL.collectNewtonIterations(profiler);
+        filterR.collectNewtonIterations(profiler);
+    }
+#endif
 private:
     MoogFilter filterL;
     MoogFilter filterR;
@@ -172,7 +241,7 @@ public:
         
         for (int smp = startSample; smp < endSample; ++smp)
         {
-            if (envelope > 0.0001)
+            if (envelope > floorLevel)
             {
                 bufferData[smp] = (float)envelope;
                 envelope *= alpha;
@@ -186,11 +255,49 @@ public:
         
     }
     
+    // advances the envelope by numSamples without rendering it and returns how many of them
+    // are above the floor, the ones after those are silent
+    int advance(const int numSamples)
+    {
+        if (envelope <= floorLevel)
+        {
+            envelope = 0.0;
+            return 0;
+        }
+        
+        const double endEnvelope = envelope * pow(alpha, numSamples);
+        if (endEnvelope > floorLevel)
+        {
+            envelope = endEnvelope;
+            return numSamples;
+        }
+        
+        const int numActive = (int)std::ceil(std::log(floorLevel / envelope) / std::log(alpha));
+        envelope = 0.0;
+        return jlimit(0, numSamples, numActive);
+    }
+    
     void noteOn()
     {
         envelope = 1;
     }
     
+    void reset()
+    {
+        envelope = 0.0;
+    }
+    
+    double getEnvelope() const
+    {
+        return envelope;
+    }
+    
+    // per-sample decay factor of the envelope
+    double getAlpha() const
+    {
+        return alpha;
+    }
+    
     // check if the envelope has (nearly) finished
     bool isActive() const
     {
@@ -211,6 +318,9 @@ private:
         alpha = pow(0.001, 1.0 / n);
     }
     
+    // below this level the envelope is considered silent
+    static constexpr double floorLevel = 0.0001;
+    
     double release;
     double sampleRate = 1.0;
     double alpha = 0.0;
@@ -219,6 +329,9 @@ private:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReleaseFilter)
 };
 
+// colour stage of the noise: a 12 dB/oct state variable filter (TPT form) that works
+// either as a low-pass or as a high-pass, depending on the colour parameter.
+// Only the active side runs, and at the centre of the knob the noise is left white.
 class NoiseFilter
 {
 public:
@@ -228,55 +341,103 @@ public:
     
     void prepareToPlay(/*double sr, */const dsp::ProcessSpec& spec)
     {
-        for (int i = 0; i < numFilters; ++i)
-        {
-            filters[i].prepare(spec);
-            filters[i].setResonance(0.2f);
-        }
-        filters[0].setMode(dsp::LadderFilter<float>::Mode::LPF12);
-        filters[0].setCutoffFrequencyHz(spec.sampleRate * 0.499);
-        filters[1].setMode(dsp::LadderFilter<float>::Mode::HPF12);
-        filters[1].setCutoffFrequencyHz(10.0f);
-        setFrequency(0.5);
+        sampleRate = spec.sampleRate;
+        reset();
+        setFrequency(colour);
+    }
+    
+    void reset()
+    {
+        ic1 = 0.0f;
+        ic2 = 0.0f;
     }
     
-//    void processBlock(AudioBuffer<float>& buffer, const int numSamples)
     void processBlock(AudioBuffer<float>& buffer, const int startSample, const int numSamples)
     {
-//        dsp::AudioBlock<float> block{ buffer.getArrayOfWritePointers(), 1, (size_t)numSamples };
-        dsp::AudioBlock<float> block{ buffer.getArrayOfWritePointers(), 1, (size_t)startSample, (size_t)numSamples };
-        dsp::ProcessContextReplacing<float> context{ block };
-                
-        filters[0].process(context);
-        filters[1].process(context);
+        if (mode == Mode::white)
+            return;
+        
+        auto* data = buffer.getWritePointer(0, startSample);
+        
+        if (mode == Mode::lowPass)
+        {
+            for (int smp = 0; smp < numSamples; ++smp)
+            {
+                float v1, v2;
+                tick(data[smp], v1, v2);
+                data[smp] = v2;
+            }
+        }
+        else
+        {
+            for (int smp = 0; smp < numSamples; ++smp)
+            {
+                float v1, v2;
+                const float x = data[smp];
+                tick(x, v1, v2);
+                data[smp] = x - k * v1 - v2;
+            }
+        }
     }
     
     void setFrequency(const float newValue)
     {
+        colour = newValue;
+        
         if (newValue < 0.5f)
         {     // low-pass
-            float frequency = juce::jmap(newValue, 0.0f, 0.5f, 80.0f, 18000.0f);
-            filters[0].setCutoffFrequencyHz(frequency);
-        }else
+            mode = Mode::lowPass;
+            cutoff = juce::jmap(newValue, 0.0f, 0.5f, 80.0f, 18000.0f);
+        }
+        else if (newValue > 0.5f)
         {     // high-pass
-            float frequency = juce::jmap(newValue, 0.5f, 1.0f, 0.1f, 800.0f);
-            filters[1].setCutoffFrequencyHz(frequency);
+            mode = Mode::highPass;
+            cutoff = juce::jmap(newValue, 0.5f, 1.0f, 0.1f, 800.0f);
         }
+        else
+        {
+            mode = Mode::white;
+        }
+        
+        updateCoefficients();
     }
     
+    // 0..1, like the resonance of the ladder filters used before
     void setQuality(const double newValue)
     {
-        for (int i = 0; i < numFilters; ++i)
-        {
-            filters[i].setResonance(newValue);
-        }
+        k = 2.0f * (1.0f - jlimit(0.0f, 0.95f, (float)newValue));
+        updateCoefficients();
     }
     
 private:
+    enum class Mode { lowPass, highPass, white };
+    
+    void tick(const float x, float& v1, float& v2)
+    {
+        const float v3 = x - ic2;
+        v1 = a1 * ic1 + a2 * v3;
+        v2 = ic2 + a2 * ic1 + a3 * v3;
+        ic1 = 2.0f * v1 - ic1;
+        ic2 = 2.0f * v2 - ic2;
+    }
     
-    // one LP one HP filter
-    static const int numFilters = 2;
-    dsp::LadderFilter<float> filters[numFilters];
+    void updateCoefficients()
+    {
+        const double fc = jmin((double)cutoff, sampleRate * 0.49);
+        const float g = (float)std::tan(MathConstants<double>::pi * fc / sampleRate);
+        a1 = 1.0f / (1.0f + g * (g + k));
+        a2 = g * a1;
+        a3 = g * a2;
+    }
+    
+    Mode mode = Mode::white;
+    double sampleRate = 44100.0;
+    float colour = Parameters::defaultNFilt;
+    float cutoff = 1000.0f;
+    // damping, 2 * (1 - resonance)
+    float k = 1.6f;
+    float a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+    float ic1 = 0.0f, ic2 = 0.0f;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NoiseFilter)
 };
@@ -0,0 +1,101 @@
+#pragma once
+#include <JuceHeader.h>
+
+#define SILENCE_HOLD_TIME 0.05f   // s below the threshold before a released voice is ended
+#define SILENCE_FADE_TIME 0.005f  // s of fade-out once it is ended
+
+// Output level of a voice, measured on each rendered range (a chunk at most). A released voice
+// whose level stays below the threshold for the hold time is faded out and ended, instead of
+// running its whole release tail; the engine also reads the level to steal the quietest voice.
+class LevelTracker
+{
+public:
+    LevelTracker(float defaultThresholdDb = -96.0f)
+    {
+        setThreshold(defaultThresholdDb);
+    }
+
+    ~LevelTracker() {}
+
+    void prepareToPlay(const double sampleRate)
+    {
+        holdSamples = roundToInt(sampleRate * SILENCE_HOLD_TIME);
+        fadeSamples = jmax(1, roundToInt(sampleRate * SILENCE_FADE_TIME));
+        reset();
+    }
+
+    // a new note starts from full level, so it is not the first candidate for stealing
+    void reset()
+    {
+        meanSquare = 1.0f;
+        silentSamples = 0;
+        fadePosition = -1;
+    }
+
+    void setThreshold(const float newValueDb)
+    {
+        const float threshold = Decibels::decibelsToGain(newValueDb, -200.0f);
+        thresholdMeanSquare = threshold * threshold;
+    }
+
+    // measures the range; while the voice is released, counts how long it has been silent
+    void process(const AudioBuffer<float>& buffer, const int startSample, const int numSamples, const bool released)
+    {
+        if (numSamples <= 0)
+            return;
+
+        float sum = 0.0f;
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        {
+            const float* data = buffer.getReadPointer(ch, startSample);
+            for (int i = 0; i < numSamples; ++i)
+                sum += data[i] * data[i];
+        }
+        meanSquare = sum / (float)(numSamples * buffer.getNumChannels());
+
+        if (released && meanSquare < thresholdMeanSquare)
+            silentSamples += numSamples;
+        else
+            silentSamples = 0;
+
+        if (fadePosition < 0 && silentSamples >= holdSamples)
+            fadePosition = 0;
+    }
+
+    // fades the range out once the voice has been silent long enough,
+    // returns true when the fade is over and the voice can be ended
+    bool applyFade(AudioBuffer<float>& buffer, const int startSample, const int numSamples)
+    {
+        if (fadePosition < 0)
+            return false;
+
+        const int fadeLength = jlimit(0, numSamples, fadeSamples - fadePosition);
+        const float startGain = 1.0f - (float)fadePosition / (float)fadeSamples;
+        const float endGain = 1.0f - (float)(fadePosition + fadeLength) / (float)fadeSamples;
+
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        {
+            buffer.applyGainRamp(ch, startSample, fadeLength, startGain, endGain);
+            buffer.clear(ch, startSample + fadeLength, numSamples - fadeLength);
+        }
+
+        fadePosition += fadeLength;
+        return fadePosition >= fadeSamples;
+    }
+
+    // mean square of the last range measured
+    float getLevel() const
+    {
+        return meanSquare;
+    }
+
+private:
+    float thresholdMeanSquare = 0.0f;
+    float meanSquare = 1.0f;
+    int holdSamples = 0;
+    int fadeSamples = 1;
+    int silentSamples = 0;
+    int fadePosition = -1;   // -1 while the voice is not fading out
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LevelTracker)
+};
@@ -29,8 +29,11 @@ float* Matrix::newtonRaphson(float in, float s1, float s2, float s3, float s4, f
         residualVector[2] = -(g * saturationLUT(out[1] - out[2]) + s3 - out[2]);
         residualVector[3] = -(g * saturationLUT(out[2] - out[3]) + s4 - out[3]);
         norm = sqrt(pow(residualVector[0], 2) + pow(residualVector[1], 2) + pow(residualVector[2], 2) + pow(residualVector[3], 2));
-        cont > 100 ? norm = threshold : cont++;
+        cont > maxIterations ? norm = threshold : cont++;
     };
+#if SUPERCORE_PROFILING
+    ++iterationCounts[Profiling::newtonBin(cont)];
+#endif
     // The saturationLUT on the out is not necessary. If the next four line are commented, the self oscillation stage of the filter is incremented when the resonance is increase.
     // With this version, thank to the saturation tanh() the self oscillation is limited even if the resonance increase.
     out[0] = saturationLUT(out[0]);
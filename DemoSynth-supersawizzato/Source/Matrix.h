@@ -10,6 +10,8 @@
 
 #pragma once
 #include <JuceHeader.h>
+#include "Profiling.h"
+#include "DspResources.h"
 //#include "PluginParameters.h"
 
 
@@ -17,15 +19,29 @@ class Matrix {
 public:
     Matrix() {};
     float* newtonRaphson(float in, float s1, float s2, float s3, float s4, float k, float g);
+    // a solve that has not converged after this many iterations is stopped where it is
+    void setMaxIterations(const int newValue) { maxIterations = newValue; }
+    // the solver starts from its last solution, which is dropped here
+    void reset() { for (auto& o : out) o = 0.0f; }
+#if SUPERCORE_PROFILING
+    // iterations of every solve since the last call, added to the profiler
+    void collectIterations(Profiling::Profiler& profiler) { profiler.addNewtonIterations(iterationCounts); }
+#endif
 
 private:
-    dsp::LookupTableTransform<float> saturationLUT{ [](float x) { return std::tanh(x); }, float(-5), float(5), 128 };
+    // one table for every filter of the process
+    const DspResources::TanhTable::Ptr tanhTable{ DspResources::getTanhTable() };
+    const dsp::LookupTableTransform<float>& saturationLUT{ tanhTable->lut };
     float jacobianMatrix[4][4] = { 0 };
     float tempMatrix[4][4] = { 0 };
     float residualVector[4] = { 0 };
     float out[4] = { 0 };
     const float threshold = 0.000001f;
     int cont = 0;
+    int maxIterations = 100;    // real time; a bounce lets the solver converge
+#if SUPERCORE_PROFILING
+    uint32 iterationCounts[Profiling::numNewtonBins] = { 0 };
+#endif
     float input = 0;
     float norm = 0;
     void inverse();
@@ -31,34 +31,47 @@ public:
     void getNextAudioBlock(AudioBuffer<float>& mixerBuffer, AudioBuffer<float>& oscillatorBuffer, AudioBuffer<float>& subBuffer, AudioBuffer<float>& noiseBuffer, const int startSample, const int numSamples, const float velocity, const int activeOscs)
     {
         // Volume proporzionale alla velocity
-        for (int ch = 0; ch < 2; ++ch)
-        {
-            oscillatorBuffer.applyGain(ch, startSample, numSamples, velocity * sawGain / std::sqrt(activeOscs));
-//            sawGainn.applyGain(oscillatorBuffer.getWritePointer(ch) + startSample, numSamples);
-        }
-        
-        subBuffer.applyGain(startSample, numSamples, velocity * subGain);
+        const float sawLevel = velocity * sawGain / std::sqrt(activeOscs);
+        const float subLevel = velocity * subGain;
         
-        // mix all buffers into one
+        // mix all buffers into one, applying the gains while adding
+        // sources whose gain is zero are skipped, the voice does not render them either
+        // (noise already has its gain applied by NoiseOsc)
         for (int ch = 0; ch < 2; ++ch)
         {
-            mixerBuffer.addFrom(ch, startSample, oscillatorBuffer, ch, startSample, numSamples);
-            mixerBuffer.addFrom(ch, startSample, subBuffer, 0, startSample, numSamples);
-            mixerBuffer.addFrom(ch, startSample, noiseBuffer, 0, startSample, numSamples);
+            if (sawLevel != 0.0f)
+                mixerBuffer.addFrom(ch, startSample, oscillatorBuffer, ch, startSample, numSamples, sawLevel);
+            if (subLevel != 0.0f)
+                mixerBuffer.addFrom(ch, startSample, subBuffer, 0, startSample, numSamples, subLevel);
+            if (noiseGain != 0.0f)
+                mixerBuffer.addFrom(ch, startSample, noiseBuffer, 0, startSample, numSamples);
         }
     }
     
     void applyMasterGainAndCopy(AudioBuffer<float>& outputBuffer, AudioBuffer<float>& mixerBuffer,
                                 const int startSample, const int numSamples)
     {
-        for (int ch = 0; ch < 2; ++ch)
+        // settled gain: scale while adding to the output
+        if (!masterGain.isSmoothing())
         {
-            masterGain.applyGain(mixerBuffer.getWritePointer(ch) + startSample, numSamples);
+            const float gain = masterGain.getTargetValue();
+            for (int ch = 0; ch < 2; ++ch)
+                outputBuffer.addFrom(ch, startSample, mixerBuffer, ch, startSample, numSamples, gain);
+            return;
         }
         
-        for (int ch = 0; ch < 2; ++ch)
+        // ramping gain: both channels get the same gain for each sample
+        auto* left = mixerBuffer.getReadPointer(0);
+        auto* right = mixerBuffer.getReadPointer(1);
+        auto* outL = outputBuffer.getWritePointer(0);
+        auto* outR = outputBuffer.getWritePointer(1);
+        
+        const int endSample = startSample + numSamples;
+        for (int smp = startSample; smp < endSample; ++smp)
         {
-            outputBuffer.addFrom(ch, startSample, mixerBuffer, ch, startSample, numSamples);
+            const float gain = masterGain.getNextValue();
+            outL[smp] += left[smp] * gain;
+            outR[smp] += right[smp] * gain;
         }
     }
     
@@ -80,6 +93,17 @@ public:
         noiseGain = newValue;
     }
     
+    // at the dbFloor the level parameters give a gain of exactly zero
+    float getSawGain() const
+    {
+        return sawGain;
+    }
+    
+    float getSubGain() const
+    {
+        return subGain;
+    }
+    
     const float getNoiseGain()
     {
         return noiseGain;
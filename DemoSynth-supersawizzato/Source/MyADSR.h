@@ -30,6 +30,13 @@ public:
         adsr2.noteOff();
     }
     
+    // back to idle, without a release
+    void reset()
+    {
+        adsr1.reset();
+        adsr2.reset();
+    }
+    
     void applyEnvelopeToBuffer (AudioBuffer<float>& buffer, const int startSample, const int numSamples)
     {
         adsr1.applyEnvelopeToBuffer(buffer, startSample, numSamples);
@@ -3,6 +3,7 @@
 #include "PluginParameters.h"
 #include "Filters.h"
 #include "Tempo.h"
+#include "VoiceArena.h"
 
 #define MAX_SAW_OSCS 16
 
@@ -18,16 +19,34 @@ public:
         blit.prepareToPlay(spec1);
     }
     
-    void getNextAudioBlock(AudioBuffer<float>& outputBuffer, AudioBuffer<double>& frequencyBuffer,
+    // the oscillator reads the shared base frequency and applies its own detune ratio,
+    // so no per-oscillator frequency buffer is needed
+    void getNextAudioBlock(AudioBuffer<float>& outputBuffer, const AudioBuffer<double>& frequencyBuffer,
+                           const double detuneRatio, int startSample, int numSamples)
+    {
+        auto* out = outputBuffer.getWritePointer(0);
+        const auto* freq = frequencyBuffer.getReadPointer(0);
+
+        int endSample = startSample + numSamples;
+        for (int k = startSample; k < endSample; ++k)
+            out[k] = getNextAudioSample(freq[k] * detuneRatio);
+    }
+    
+    // fast path for blocks where the frequency does not change
+    void getNextAudioBlock(AudioBuffer<float>& outputBuffer, const double frequency,
                            int startSample, int numSamples)
     {
+        auto* out = outputBuffer.getWritePointer(0);
+
         int endSample = startSample + numSamples;
         for (int k = startSample; k < endSample; ++k)
-        {
-            double frequencySample = frequencyBuffer.getSample(0, k);
-            const float sampleValue = getNextAudioSample(frequencySample);
-            outputBuffer.addSample(0, k, sampleValue);
-        }
+            out[k] = getNextAudioSample(frequency);
+    }
+    
+    // keeps the oscillator running while it is not heard
+    void skip(const double frequency, int numSamples)
+    {
+        blit.skip(frequency, numSamples, waveform);
     }
     
     float getNextAudioSample(double frequencySample)
@@ -50,6 +69,11 @@ public:
     {
         blit.clearAccumulator();
     }
+    
+    void reset()
+    {
+        blit.reset();
+    }
 
 private:
     Blit blit;
@@ -61,38 +85,56 @@ private:
 class SawOscillators
 {
 public:
-    SawOscillators(){}
+    SawOscillators() : activeOscs(Parameters::defaultSawNum)
+    {
+        updateDetuneRatios();
+    }
     ~SawOscillators(){}
     
     SawOscillators(int defaultSawNum, int defaultDetune, float defaultStereoWidth)
     : activeOscs(defaultSawNum),  sawDetune(defaultDetune), sawStereoWidth(defaultStereoWidth)
     {
+        setDetune(defaultDetune);
     };
     
     void prepareToPlay(const dsp::ProcessSpec specInput)
     {
         spec = specInput;
-        tmpPanBuffer.setSize(1, spec.maximumBlockSize);
+        // a voice has placed the buffer in its arena already
+        if (!bufferPlaced)
+        {
+            tmpPanBuffer.setSize(1, spec.maximumBlockSize);
+            FloatVectorOperations::clear(tmpPanBuffer.getWritePointer(0), tmpPanBuffer.getNumSamples());
+        }
         
         // Inizializzo l'oscillatore
         for (int i = 0; i < MAX_SAW_OSCS; ++i)
-        {
             blitsOscs[i].prepareToPlay(specInput);
-            frequencyBuffers[i].setSize(1, spec.maximumBlockSize);
-        }
         
-        setActiveOscs(Parameters::defaultSawNum);
+        // the saw count set by the parameter is kept
+        updateDetuneRatios();
     }
     
+    // the scratch buffer goes in the arena of the voice, before prepareToPlay
+    void placeBuffers(VoiceArena& arena, const int maximumBlockSize)
+    {
+        arena.place(tmpPanBuffer, 1, maximumBlockSize);
+        bufferPlaced = true;
+    }
+
     void releaseResources()
     {
         tmpPanBuffer.setSize(0, 0);
-        for (int i = 0; i < MAX_SAW_OSCS; ++i)
-        {
-            frequencyBuffers[i].setSize(0, 0);
-        }
+        bufferPlaced = false;
     }
 
+    // clears what the oscillators kept from the previous run
+    void reset()
+    {
+        for (int i = 0; i < MAX_SAW_OSCS; ++i)
+            blitsOscs[i].reset();
+    }
+    
     void startNote()
     {
         // if phase resetting is ON then set it to the selected value by the user
@@ -101,58 +143,51 @@ public:
     }
     
     // the process method now with stereo width parameter that pans every oscillator
-    void process(AudioBuffer<float>& buffer, AudioBuffer<double>& frequencyBuffer,
+    void process(AudioBuffer<float>& buffer, const AudioBuffer<double>& frequencyBuffer,
                  const int startSampleOversampled, const int numSamplesOversampled)
     {
-        auto* left = buffer.getWritePointer(0);
-        auto* right = buffer.getWritePointer(1);
-        
-        setSawFreqs(frequencyBuffer, startSampleOversampled, numSamplesOversampled);
-        
         for (int i = 0; i < activeOscs; ++i)
         {
-            tmpPanBuffer.clear();
-            
-            float oscPosition;
-            if (activeOscs == 1)
-                oscPosition = 0.5f; // don't pan if activeOscs = 1
-            else
-                oscPosition = static_cast<float>(i) / static_cast<float>(activeOscs - 1);
-
-            // since sawStereoWidth's range is [0.0f, 1.0f], we have to work around it to get the pan value right
-            float pan = juce::jmap(sawStereoWidth, 0.5f, oscPosition);
-            
-            // equal power (constant power) panning law
-            float leftGain  = std::cos(pan * juce::MathConstants<float>::halfPi);
-            float rightGain = std::sin(pan * juce::MathConstants<float>::halfPi);
-
-            // use tmpPanBuffer to process the oscillators
+            // use tmpPanBuffer to process the oscillators (it is overwritten, no need to clear it)
             // then add its contents to the main buffer applying the pan on buffers
-            blitsOscs[i].getNextAudioBlock(tmpPanBuffer, frequencyBuffers[i],
+            blitsOscs[i].getNextAudioBlock(tmpPanBuffer, frequencyBuffer, detuneRatios[i],
                                            startSampleOversampled, numSamplesOversampled);
-        
-            const float* tmp = tmpPanBuffer.getReadPointer(0);
-            const int endSampleOs = startSampleOversampled + numSamplesOversampled;
-            for (int smp = startSampleOversampled; smp < endSampleOs; ++smp)
-            {
-                left[smp]  += tmp[smp] * leftGain;
-                right[smp] += tmp[smp] * rightGain;
-            }
+            addPanned(buffer, i, startSampleOversampled, numSamplesOversampled);
         }
     }
     
+    // same as above when the base frequency is constant for the whole block:
+    // the detuned frequency of each oscillator is computed once instead of per sample
+    void process(AudioBuffer<float>& buffer, const double baseFrequency,
+                 const int startSampleOversampled, const int numSamplesOversampled)
+    {
+        for (int i = 0; i < activeOscs; ++i)
+        {
+            blitsOscs[i].getNextAudioBlock(tmpPanBuffer, baseFrequency * detuneRatios[i],
+                                           startSampleOversampled, numSamplesOversampled);
+            addPanned(buffer, i, startSampleOversampled, numSamplesOversampled);
+        }
+    }
+    
+    // the saws are not heard: they are advanced without being rendered, so they come back in phase
+    void skip(const double baseFrequency, const int numSamplesOversampled)
+    {
+        for (int i = 0; i < activeOscs; ++i)
+            blitsOscs[i].skip(baseFrequency * detuneRatios[i], numSamplesOversampled);
+    }
+    
     // methods to calculate the frequencies of each oscillator
     
     // depending on the number of saws and detune value
-    // the frequencies of the rest of the oscillators have to be calculated
+    // the frequency ratios of the oscillators have to be calculated
     // if numSaw odd --> then base is unchanged and the rest will be as before
     // if numSaw even --> then also the 1st oscillator's frequency will be detuned
-    // freqBuffer and all frequencyBuffers are in the OVERSAMPLED buffer size
-    void setSawFreqs(AudioBuffer<double>& freqBuffer, const int startSampleOversampled, const int numSamplesOversampled)
+    // the table only depends on (activeOscs, detune), so it is rebuilt when one of them changes
+    // and every oscillator multiplies the shared base frequency by its own ratio
+    void updateDetuneRatios()
     {
-        const int endSampleOversampled = startSampleOversampled + numSamplesOversampled;
-
-        frequencyBuffers[0].copyFrom(0, startSampleOversampled, freqBuffer, 0, startSampleOversampled, numSamplesOversampled);
+        for (int i = 0; i < MAX_SAW_OSCS; ++i)
+            detuneRatios[i] = 1.0;
 
         if (activeOscs < 2)
             return;
@@ -173,12 +208,8 @@ public:
             else
                 detuneAmount = pow(cent, static_cast<double>(pairIndex) / numPairs);
 
-            for (int j = startSampleOversampled; j < endSampleOversampled; ++j)
-            {
-                const double sample = freqBuffer.getSample(0, j);
-                frequencyBuffers[i].setSample(0, j, sample * detuneAmount);
-                frequencyBuffers[i + 1].setSample(0, j, sample / detuneAmount);
-            }
+            detuneRatios[i] = detuneAmount;
+            detuneRatios[i + 1] = 1.0 / detuneAmount;
         }
     }
     
@@ -196,6 +227,7 @@ public:
     {
         sawDetune = newValue;
         cent = pow(root, newValue);
+        updateDetuneRatios();
     }
     
     void setStereoWidth(const float newValue)
@@ -219,7 +251,8 @@ public:
     
     void setActiveOscs(const int newValue)
     {
-        activeOscs = newValue;
+        activeOscs = jlimit(1, MAX_SAW_OSCS, newValue);
+        updateDetuneRatios();
     }
     
     int getActiveOscs()
@@ -228,13 +261,43 @@ public:
     }
     
 private:
+    // adds the content of tmpPanBuffer to the stereo buffer with the pan of oscillator oscIndex
+    void addPanned(AudioBuffer<float>& buffer, const int oscIndex, const int startSampleOversampled, const int numSamplesOversampled)
+    {
+        auto* left = buffer.getWritePointer(0);
+        auto* right = buffer.getWritePointer(1);
+
+        float oscPosition;
+        if (activeOscs == 1)
+            oscPosition = 0.5f; // don't pan if activeOscs = 1
+        else
+            oscPosition = static_cast<float>(oscIndex) / static_cast<float>(activeOscs - 1);
+
+        // since sawStereoWidth's range is [0.0f, 1.0f], we have to work around it to get the pan value right
+        float pan = juce::jmap(sawStereoWidth, 0.5f, oscPosition);
+        
+        // equal power (constant power) panning law
+        float leftGain  = std::cos(pan * juce::MathConstants<float>::halfPi);
+        float rightGain = std::sin(pan * juce::MathConstants<float>::halfPi);
+
+        const float* tmp = tmpPanBuffer.getReadPointer(0);
+        const int endSampleOs = startSampleOversampled + numSamplesOversampled;
+        for (int smp = startSampleOversampled; smp < endSampleOs; ++smp)
+        {
+            left[smp]  += tmp[smp] * leftGain;
+            right[smp] += tmp[smp] * rightGain;
+        }
+    }
+    
     dsp::ProcessSpec spec;
 
     MoogOsc blitsOscs[MAX_SAW_OSCS];
     int activeOscs;          // to obtain the JP8000 supersaw sound, 7 detuned oscillators must be used
     
     AudioBuffer<float> tmpPanBuffer;
-    AudioBuffer<double> frequencyBuffers[MAX_SAW_OSCS];
+    bool bufferPlaced = false;
+    // frequency ratio of each oscillator to the base frequency, see updateDetuneRatios()
+    double detuneRatios[MAX_SAW_OSCS];
     
     // osc params
     int sawDetune;
@@ -253,6 +316,98 @@ private:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SawOscillators)
 };
 
+// White noise generator built from several independent xorshift32 generators running side by side:
+// filling a block is a plain loop over the lanes that the compiler can vectorise
+class FastNoise
+{
+public:
+    // each generator of the process plays its own sequence, so voices struck together do not add
+    // up the same noise
+    FastNoise() : FastNoise(nextSeed()) {}
+    
+    explicit FastNoise(const uint32 seed)
+    {
+        setSeed(seed);
+    }
+    
+    ~FastNoise(){}
+    
+    void setSeed(const uint32 seed)
+    {
+        for (int l = 0; l < numLanes; ++l)
+        {
+            // xorshift must never be seeded with zero
+            state[l] = (seed ^ (0x9E3779B9u * static_cast<uint32>(l + 1))) | 1u;
+            for (int i = 0; i < 8; ++i)
+                next(state[l]);
+        }
+    }
+    
+    // uniform noise in [-1, 1) multiplied by gain * decay^n, n being the index of the sample,
+    // so that an exponential envelope can be applied in the same pass
+    void fillUniform(float* dest, const int numSamples, const float gain = 1.0f, const float decay = 1.0f)
+    {
+        float laneGain[numLanes];
+        float laneDecay = 1.0f;
+        for (int l = 0; l < numLanes; ++l)
+        {
+            laneGain[l] = gain * laneDecay;
+            laneDecay *= decay;
+        }
+        
+        int smp = 0;
+        for (; smp + numLanes <= numSamples; smp += numLanes)
+        {
+            for (int l = 0; l < numLanes; ++l)
+            {
+                dest[smp + l] = toBipolar(next(state[l])) * laneGain[l];
+                laneGain[l] *= laneDecay;
+            }
+        }
+        
+        for (int l = 0; smp < numSamples; ++smp, ++l)
+            dest[smp] = toBipolar(next(state[l])) * laneGain[l];
+    }
+    
+private:
+    // a count of the generators made so far rather than a random seed: a render that creates its
+    // voices in the same order plays the same noise (the golden renders depend on it)
+    static uint32 nextSeed()
+    {
+        static std::atomic<uint32> created { 0 };
+        uint32 x = 0x9E3779B9u * (created.fetch_add(1, std::memory_order_relaxed) + 1u);
+        // murmur3 finaliser, so that consecutive counts give unrelated seeds
+        x ^= x >> 16;
+        x *= 0x85EBCA6Bu;
+        x ^= x >> 13;
+        x *= 0xC2B2AE35u;
+        x ^= x >> 16;
+        return x;
+    }
+    
+    static uint32 next(uint32& x)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return x;
+    }
+    
+    // the 23 high bits become the mantissa of a float in [2, 4), then shifted to [-1, 1)
+    static float toBipolar(const uint32 x)
+    {
+        const uint32 bits = (x >> 9) | 0x40000000u;
+        float value;
+        std::memcpy(&value, &bits, sizeof(float));
+        return value - 3.0f;
+    }
+    
+    static const int numLanes = 8;
+    uint32 state[numLanes];
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FastNoise)
+};
+
 class NoiseOsc
 {
 public:
@@ -261,16 +416,21 @@ public:
     
     void releaseResources()
     {
-        noiseEnvelope.setSize(0, 0);
     }
     
     void prepareToPlay(const dsp::ProcessSpec& spec)
     {
         // NOISE
         // We prepare the release envelope generator of the noise osc
-        noiseEnvelope.setSize(1, spec.maximumBlockSize);
-        noiseEnvelope.clear();
         egNoise.prepareToPlay(spec.sampleRate);
+        colourFilter.prepareToPlay(spec);
+    }
+    
+    // the envelope is silent and the colour filter cleared
+    void reset()
+    {
+        egNoise.reset();
+        colourFilter.reset();
     }
     
     void trigger(int startSample, float velocity)
@@ -283,24 +443,20 @@ public:
         
     }
     
+    // writes the noise (already coloured and shaped by its release envelope, velocity and gain) into the first channel
     void process(AudioBuffer<float>& buffer, int startSample, int numSamples, float gain)
     {
-//        buffer.clear();
-//        noiseEnvelope.clear();
         if (velocityLevel <= 0.0001f || gain <= 0.0001f || !egNoise.isActive())
             return;
-        auto noiseData = buffer.getArrayOfWritePointers();
         
-        egNoise.processBlock(noiseEnvelope, startSample, numSamples);
-        const auto numChannels = buffer.getNumChannels();
-        for (int ch = 0; ch < numChannels; ++ch)
-            for (int smp = 0; smp < numSamples; ++smp)
-                noiseData[ch][smp] += velocityLevel * gain * ((noise.nextFloat() * 2.0f) - 1.0f);
+        // the release envelope is exponential, so it is applied by the generator itself:
+        // only the samples where it is above its floor are generated, the rest of the buffer stays silent
+        const float envelope = static_cast<float>(egNoise.getEnvelope());
+        const float decay = static_cast<float>(egNoise.getAlpha());
+        const int numActive = egNoise.advance(numSamples);
         
-        for (int ch = 0; ch < numChannels; ++ch)
-        {
-            FloatVectorOperations::multiply(noiseData[ch], noiseEnvelope.getReadPointer(0), numSamples);
-        }
+        noise.fillUniform(buffer.getWritePointer(0, startSample), numActive, velocityLevel * gain * envelope, decay);
+        colourFilter.processBlock(buffer, startSample, numActive);
     }
     
     void setRelease(const float newValue)
@@ -308,6 +464,12 @@ public:
         egNoise.setRelease(newValue);
     }
     
+    // colour knob: low-pass below 0.5, high-pass above
+    void setColour(const float newValue)
+    {
+        colourFilter.setFrequency(newValue);
+    }
+    
     bool envFinished() const
     {
         return !egNoise.isActive();
@@ -317,16 +479,187 @@ public:
 private:
     float velocityLevel = 0.7f;
 
-    // We use the JUCE class Random to generate noise
-    Random noise;
-    AudioBuffer<float> noiseEnvelope;
+    FastNoise noise;
     // envelope generator for the noise osc
     ReleaseFilter egNoise;
+    // filter for the colour of the noise
+    NoiseFilter colourFilter;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NoiseOsc)
 };
 
 
+// Sub oscillator: sine from a complex rotation (no sin() per sample) and polyBLEP square.
+// While the frequency is not gliding the phase increment and the rotation are hoisted out of the loop.
+class SubOscillator
+{
+public:
+    enum Waveform
+    {
+        sine = 0,
+        square
+    };
+    
+    SubOscillator(const double defaultFrequency = 20.0)
+    {
+        frequency.setCurrentAndTargetValue(defaultFrequency);
+    }
+    
+    ~SubOscillator(){}
+    
+    void prepareToPlay(const double sr)
+    {
+        frequency.reset(sr, 0.02);
+        samplePeriod = 1.0 / sr;
+        rotationFrequency = 0.0;
+    }
+    
+    void setFrequency(const double newValue)
+    {
+        // no zero-frequency allowed
+        jassert(newValue > 0);
+        frequency.setTargetValue(newValue);
+    }
+    
+    void setWaveform(const int newValue)
+    {
+        waveform = newValue == square ? square : sine;
+    }
+    
+    void resetPhase()
+    {
+        currentPhase = 0.0;
+    }
+    
+    // from the start of the period, with any glide finished
+    void reset()
+    {
+        resetPhase();
+        frequency.setCurrentAndTargetValue(frequency.getTargetValue());
+    }
+    
+    void getNextAudioBlock(AudioBuffer<float>& buffer, const int startSample, const int numSamples)
+    {
+        auto* data = buffer.getWritePointer(0, startSample);
+        
+        if (frequency.isSmoothing())
+        {
+            // gliding: the increment changes every sample
+            for (int smp = 0; smp < numSamples; ++smp)
+            {
+                const double increment = frequency.getNextValue() * samplePeriod;
+                data[smp] = waveform == sine ? (float)std::sin(MathConstants<double>::twoPi * currentPhase)
+                                             : squareSample(currentPhase, increment);
+                advancePhase(increment);
+            }
+            return;
+        }
+        
+        const double increment = frequency.getTargetValue() * samplePeriod;
+        
+        if (waveform == sine)
+            renderSine(data, numSamples, increment);
+        else
+            renderSquare(data, numSamples, increment);
+    }
+    
+    // the sub is not heard: its phase (and glide) move on as if it had been rendered
+    void skip(const int numSamples)
+    {
+        if (frequency.isSmoothing())
+        {
+            for (int smp = 0; smp < numSamples; ++smp)
+                advancePhase(frequency.getNextValue() * samplePeriod);
+            return;
+        }
+        
+        currentPhase += frequency.getTargetValue() * samplePeriod * numSamples;
+        currentPhase -= std::floor(currentPhase);
+    }
+    
+private:
+    void renderSine(float* data, const int numSamples, const double increment)
+    {
+        // rotation by the phase increment, recomputed only when the frequency changes
+        if (frequency.getTargetValue() != rotationFrequency)
+        {
+            rotationFrequency = frequency.getTargetValue();
+            rotationCos = std::cos(MathConstants<double>::twoPi * increment);
+            rotationSin = std::sin(MathConstants<double>::twoPi * increment);
+        }
+        
+        // the phasor starts from the current phase every block, so rounding errors cannot accumulate
+        double re = std::cos(MathConstants<double>::twoPi * currentPhase);
+        double im = std::sin(MathConstants<double>::twoPi * currentPhase);
+        
+        for (int smp = 0; smp < numSamples; ++smp)
+        {
+            data[smp] = (float)im;
+            const double nextRe = re * rotationCos - im * rotationSin;
+            im = re * rotationSin + im * rotationCos;
+            re = nextRe;
+        }
+        
+        currentPhase += increment * numSamples;
+        currentPhase -= std::floor(currentPhase);
+    }
+    
+    void renderSquare(float* data, const int numSamples, const double increment)
+    {
+        for (int smp = 0; smp < numSamples; ++smp)
+        {
+            data[smp] = squareSample(currentPhase, increment);
+            advancePhase(increment);
+        }
+    }
+    
+    // -1 in the first half of the period, +1 in the second one, with polyBLEP corrected edges
+    static float squareSample(const double phase, const double increment)
+    {
+        double value = phase < 0.5 ? -1.0 : 1.0;
+        double shiftedPhase = phase + 0.5;
+        shiftedPhase -= static_cast<int>(shiftedPhase);
+        
+        value -= polyBlep(phase, increment);         // falling edge at phase 0
+        value += polyBlep(shiftedPhase, increment);  // rising edge at phase 0.5
+        return (float)value;
+    }
+    
+    static double polyBlep(double t, const double dt)
+    {
+        if (t < dt)
+        {
+            t /= dt;
+            return t + t - t * t - 1.0;
+        }
+        if (t > 1.0 - dt)
+        {
+            t = (t - 1.0) / dt;
+            return t * t + t + t + 1.0;
+        }
+        return 0.0;
+    }
+    
+    void advancePhase(const double increment)
+    {
+        currentPhase += increment;
+        currentPhase -= static_cast<int>(currentPhase);
+    }
+    
+    int waveform = sine;
+    SmoothedValue<double, ValueSmoothingTypes::Multiplicative> frequency;
+    double samplePeriod = 1.0 / 44100.0;
+    double currentPhase = 0.0;
+    
+    // rotation of the sine phasor for rotationFrequency
+    double rotationFrequency = 0.0;
+    double rotationCos = 1.0;
+    double rotationSin = 0.0;
+    
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SubOscillator)
+};
+
+
 class NaiveOscillator {
 public:
     NaiveOscillator(const double defaultFrequency, const int defaultWaveform)
@@ -386,15 +719,6 @@ public:
         }
     }
     
-    void getNextAudioBlockFloat(AudioBuffer<float>& buffer, const int startSample, const int numSamples)
-    {
-        auto data = buffer.getArrayOfWritePointers();
-
-        const int endSample = startSample + numSamples;
-        for (int smp = startSample; smp < endSample; ++smp)
-            data[0][smp] = getNextAudioSample();
-    }
-
     float getNextAudioSample()
     {
         auto sampleValue = 0.0;
@@ -10,6 +10,7 @@
 
 #pragma once
 #include <JuceHeader.h>
+#include "DspResources.h"
 
 class Oversampling {
 public:
@@ -40,14 +41,10 @@ public:
         size_t filterOrder = 64;    // 32~ sample --> approx. 0.7 ms at 44.1kHz or 0.66 ms at 47 kHz
         // modify: change the order to reduce aliasing but introduce more latency
         
-        firCoeffs = juce::dsp::FilterDesign<float>::designFIRLowpassWindowMethod(
-            cutoff,
-            sampleRateOs,
-            filterOrder,
-            juce::dsp::WindowingFunction<float>::blackman
-        );
-        antialiasingFilterL.coefficients = firCoeffs.get();
-        antialiasingFilterR.coefficients = firCoeffs.get();
+        // blackman windowed, designed once per rate for every voice of every instance
+        firLowpass = DspResources::getFirLowpass(cutoff, sampleRateOs, (int)filterOrder);
+        antialiasingFilterL.coefficients = firLowpass->coefficients;
+        antialiasingFilterR.coefficients = firLowpass->coefficients;
         
         // IIR
 //        iirCoeffs = juce::dsp::FilterDesign<float>::designIIRLowpassHighOrderButterworthMethod(
@@ -113,7 +110,7 @@ private:
     // fir
     juce::dsp::FIR::Filter<float> antialiasingFilterL, antialiasingFilterR;
 //    juce::dsp::FIR::Coefficients<float>::Ptr firCoeffs;
-    juce::ReferenceCountedObjectPtr<juce::dsp::FIR::Coefficients<float>> firCoeffs;
+    DspResources::FirLowpass::Ptr firLowpass;
 //    juce::ReferenceCountedObjectPtr<juce::dsp::FIR::Coefficients<float>> firCoeffs;
 
     // iir
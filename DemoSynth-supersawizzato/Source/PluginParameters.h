@@ -1,6 +1,7 @@
 #pragma once
 #include <JuceHeader.h>
 #include "Tempo.h"
+#include "RenderWorkers.h"
 
 namespace Parameters
 {
@@ -33,9 +34,40 @@ namespace Parameters
     static const String nameNFilt = "NFILT";
 //    static const String nameOversampling = "OVERSMP";
     static const String nameMaster = "MASTER";
+    static const String nameSilence = "SILENCE";
+    static const String nameVoices = "VOICES";
+    static const String nameRenderThreads = "THREADS";
+    static const String nameParallelVoices = "PARVOICES";
+    static const String nameRenderAhead = "AHEAD";
+
+    // DENSE INDEX, the audio thread addresses parameters by position instead of by ID
+    enum Index
+    {
+        mainWf = 0, sawReg, sawNum, detune, stereoWidth, phase,
+        sawLev, subLev, nLev,
+        atk, dcy, sus, rel,
+        subReg, subWf,
+        filtHz, filtQ, filtEnv, filtLfoAmt,
+        lfoWf, lfoFreq, lfoRate, lfoSync,
+        nRel, nFilt,
+        master, silence, voices, renderThreads, parallelVoices, renderAhead,
+        numParams
+    };
+
+    static const String ids[numParams] = {
+        nameMainWf, nameSawReg, nameSawNum, nameDetune, nameStereoWidth, namePhase,
+        nameSawLev, nameSubLev, nameNLev,
+        nameAtk, nameDcy, nameSus, nameRel,
+        nameSubReg, nameSubWf,
+        nameFiltHz, nameFiltQ, nameFiltEnv, nameFiltLfoAmt,
+        nameLfoWf, nameLfoFreq, nameLfoRate, nameLfoSync,
+        nameNRel, nameNFilt,
+        nameMaster, nameSilence, nameVoices, nameRenderThreads, nameParallelVoices, nameRenderAhead
+    };
 
     // CONSTANTS
     static const float dbFloor = -48.0f;
+    static const int maxVoices = 64;
 
     // PARAM DEFAULTS
 	static const float defaultAtk = 0.01f;
@@ -53,6 +85,7 @@ namespace Parameters
     static const float defaultNoiseRel = 0.7f;
     static const float defaultNFilt = 0.5f;
     static const float defaultMaster = 0.8f;
+    static const float defaultSilence = -96.0f;
     
     static const int defaultSawReg = 2; // in this case, it sets the default register to 0
     static const int defaultSawNum = 5;
@@ -64,8 +97,46 @@ namespace Parameters
     static const int defaultLfoWf = 0;
     static const int defaultLfoSync = 0;
     static const int defaultLfoRate = 0;
+    static const int defaultVoices = 8;
+    static const int defaultRenderThreads = 0;
+    static const int defaultParallelVoices = 8;
+    static const int defaultRenderAhead = 0;
 //    static const int defaultOversampling = 0;
 
+    // engine settings while playing in real time
+    static const int realtimeOversampling = 2;
+    static const int realtimeNewtonIterations = 100;
+
+    // what the processor switches to while the host renders offline, kept as properties of the
+    // state (not parameters) so that every project has its own
+    struct BounceProfile
+    {
+        int oversampling = 4;           // of the saws
+        int newtonIterations = 1000;    // cap of the ladder's solver, per sample
+        bool parallel = true;           // voices spread over every core
+
+        static const Identifier& oversamplingId()      { static const Identifier id("bounceOversampling"); return id; }
+        static const Identifier& newtonIterationsId()  { static const Identifier id("bounceNewtonIterations"); return id; }
+        static const Identifier& parallelId()          { static const Identifier id("bounceParallel"); return id; }
+
+        // the defaults for what the state does not have
+        static BounceProfile fromState(const ValueTree& state)
+        {
+            BounceProfile profile;
+            profile.oversampling = jlimit(1, 8, (int)state.getProperty(oversamplingId(), profile.oversampling));
+            profile.newtonIterations = jlimit(realtimeNewtonIterations, 100000, (int)state.getProperty(newtonIterationsId(), profile.newtonIterations));
+            profile.parallel = (bool)state.getProperty(parallelId(), profile.parallel);
+            return profile;
+        }
+
+        void writeTo(ValueTree& state) const
+        {
+            state.setProperty(oversamplingId(), oversampling, nullptr);
+            state.setProperty(newtonIterationsId(), newtonIterations, nullptr);
+            state.setProperty(parallelId(), parallel, nullptr);
+        }
+    };
+
 	static AudioProcessorValueTreeState::ParameterLayout createParameterLayout()
 	{
 		std::vector<std::unique_ptr<RangedAudioParameter>> params;
@@ -102,6 +173,11 @@ namespace Parameters
         params.push_back(std::make_unique<AudioParameterFloat>(ParameterID { nameNFilt, 25 }, "Noise Color/Filter (LPF,HPF)", NormalisableRange<float>(0.0f, 1.0f), defaultNFilt));
 //        params.push_back(std::make_unique<AudioParameterChoice>(ParameterID { nameOversampling, 26 }, "Oversampling -- not yet implemented", StringArray{"2X","4X"}, defaultOversampling));
         params.push_back(std::make_unique<AudioParameterFloat>(ParameterID { nameMaster, 26 }, "Master", NormalisableRange<float>(-48.0f, 0.0f), defaultMaster));
+        params.push_back(std::make_unique<AudioParameterInt>(ParameterID { nameVoices, 27 }, "Voices", 1, maxVoices, defaultVoices));
+        params.push_back(std::make_unique<AudioParameterInt>(ParameterID { nameRenderThreads, 28 }, "Render Threads (0 = off)", 0, MAX_RENDER_WORKERS, defaultRenderThreads));
+        params.push_back(std::make_unique<AudioParameterInt>(ParameterID { nameParallelVoices, 29 }, "Parallel Above (voices)", 2, maxVoices, defaultParallelVoices));
+        params.push_back(std::make_unique<AudioParameterChoice>(ParameterID { nameRenderAhead, 30 }, "Render Ahead (adds one block of latency)", StringArray{"OFF","ON"}, defaultRenderAhead));
+        params.push_back(std::make_unique<AudioParameterFloat>(ParameterID { nameSilence, 31 }, "Voice Off Below (dB)", NormalisableRange<float>(-120.0f, -60.0f), defaultSilence));
         
 
 		return { params.begin(), params.end() };
@@ -2,21 +2,128 @@
 #include "PluginParameters.h"
 #include "SupersawEditor.h"
 
-#define NUM_VOICES 8
-
 //==============================================================================
 DemoSynthAudioProcessor::DemoSynthAudioProcessor()
      : AudioProcessor (BusesProperties().withOutput ("Output", juce::AudioChannelSet::stereo(), true)),
        parameters(*this, nullptr, "SynthSettings", { Parameters::createParameterLayout() })
 {
-    mySynth.clearSounds();
-    mySynth.clearVoices();
-    mySynth.addSound(new MySynthSound());
+    // the oscillators' table is built in the background while the host loads the project
+    Blit::prefetchSharedTable();
+
+    for (int i = 0; i < Parameters::numParams; ++i)
+    {
+        parameterValues[i] = parameters.getRawParameterValue(Parameters::ids[i]);
+        appliedValues[i] = parameterValues[i]->load();
+    }
 
-    for (int v = 0; v < NUM_VOICES; ++v)
-        mySynth.addVoice(new SimpleSynthVoice(Parameters::defaultAtk, Parameters::defaultDcy, Parameters::defaultSus, Parameters::defaultRel));
+    // the bounce profile is written in the state, so that it is saved with it and can be edited there
+    Parameters::BounceProfile().writeTo(parameters.state);
+
+    mySynth.setNumVoices(Parameters::defaultVoices, [this] { return createVoice(); });
+    mySynth.updateVoicePool();
+    applyParallelRendering();
 
     Parameters::addListenerToAllParameters(parameters, this);
+    startTimer(50);
+}
+
+DemoSynthAudioProcessor::~DemoSynthAudioProcessor()
+{
+    cancelPendingUpdate();
+    stopTimer();
+
+    renderAhead.stop();
+    mySynth.setRenderWorkers(nullptr);
+    renderWorkers.reset();
+}
+
+SimpleSynthVoice* DemoSynthAudioProcessor::createVoice()
+{
+    auto* voice = new SimpleSynthVoice();
+    voice->setHostPosition(&hostPosition);
+    voice->setProfiler(&profiler);
+    voice->setOversamplingFactor(voiceOversampling);
+    voice->setMaxNewtonIterations(voiceNewtonIterations);
+
+    // a voice added later must sound like the ones already in the pool
+    for (int i = 0; i < Parameters::numParams; ++i)
+        voice->setParameter(i, parameterValues[i]->load());
+
+    if (preparedSampleRate > 0.0)
+        voice->prepareToPlay(preparedSampleRate, RENDER_CHUNK_SIZE);
+
+    return voice;
+}
+
+// the voice count and the workers the parameters ask for; message thread, or the thread that
+// prepares the processor
+void DemoSynthAudioProcessor::updatePool()
+{
+    const ScopedLock sl(poolLock);
+
+    const int target = jlimit(1, Parameters::maxVoices, targetVoices.load());
+    if (target != numVoicesSet)
+    {
+        numVoicesSet = target;
+        mySynth.setNumVoices(target, [this] { return createVoice(); });
+    }
+
+    // the workers sleep when they are not needed, they are not deleted when parallel rendering is switched off
+    if (renderWorkersWanted.exchange(false))
+        createRenderWorkers();
+
+    // removed voices are deleted once the audio thread has let them go
+    mySynth.deleteRetiredVoices();
+}
+
+void DemoSynthAudioProcessor::handleAsyncUpdate()
+{
+    updatePool();
+
+    // a switch between real-time and offline rendering that the host did not prepare for; the
+    // lock is not held while processing is suspended, a host may prepare with its callback lock held
+    bool prepareAgain;
+    {
+        const ScopedLock sl(poolLock);
+        prepareAgain = renderModeChanged.exchange(false) && preparedSampleRate > 0.0 && isNonRealtime() != bouncing;
+    }
+
+    if (prepareAgain)
+    {
+        suspendProcessing(true);
+        prepareToPlay(getSampleRate(), getBlockSize());
+        suspendProcessing(false);
+    }
+}
+
+void DemoSynthAudioProcessor::createRenderWorkers()
+{
+    if (renderWorkers != nullptr)
+        return;
+
+    renderWorkers.reset(new SharedResourcePointer<RenderWorkers>());
+    mySynth.setRenderWorkers(&renderWorkers->get());
+}
+
+// the parameters, or every core while bouncing; audio thread, or message thread with it stopped
+void DemoSynthAudioProcessor::applyParallelRendering()
+{
+    if (bouncing && bounceProfile.parallel)
+        mySynth.setParallelRendering(MAX_RENDER_WORKERS, 2);
+    else
+        mySynth.setParallelRendering(roundToInt(appliedValues[Parameters::renderThreads]),
+                                     roundToInt(appliedValues[Parameters::parallelVoices]));
+}
+
+// what the audio thread leaves to the message thread without posting to it, which could lock
+void DemoSynthAudioProcessor::timerCallback()
+{
+    // the latency follows the render-ahead mode actually in use
+    const int latency = renderAheadEngaged.load() ? renderAhead.getLatency() : 0;
+    if (latency != getLatencySamples())
+        setLatencySamples(latency);
+
+    updatePool();
 }
 
 //==============================================================================
@@ -29,19 +136,79 @@ bool DemoSynthAudioProcessor::acceptsMidi() const
 //==============================================================================
 void DemoSynthAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    mySynth.setCurrentPlaybackSampleRate(sampleRate);
+    // the timer does not change the pool while it is being prepared
+    const ScopedLock sl(poolLock);
+
+    // a pending switch of the profile is made here anyway. Hosts and the Renderer prepare from
+    // other threads than the message thread, where handleUpdateNowIfNeeded() must not be called:
+    // the update is cancelled instead, and the pool is set here directly
+    renderModeChanged = false;
+    cancelPendingUpdate();
+    preparedSampleRate = sampleRate;
+
+    // the voice count asked for is set first, so that every voice gets prepared below
+    updatePool();
+
+    // offline, quality and throughput come before real-time safety
+    bouncing = isNonRealtime();
+    bounceProfile = Parameters::BounceProfile::fromState(parameters.state);
+    voiceOversampling = bouncing ? bounceProfile.oversampling : Parameters::realtimeOversampling;
+    voiceNewtonIterations = bouncing ? bounceProfile.newtonIterations : Parameters::realtimeNewtonIterations;
+
+    if (bouncing && bounceProfile.parallel)
+        createRenderWorkers();
+    applyParallelRendering();
+
 //    mySynth.setNoteStealingEnabled(true);
 
-    for (int v = 0; v < mySynth.getNumVoices(); ++v)
-        if (auto voice = dynamic_cast<SimpleSynthVoice*>(mySynth.getVoice(v)))
-            voice->prepareToPlay(sampleRate, samplesPerBlock);
+    // the audio thread is not running here, the pool can be settled right away
+    mySynth.updateVoicePool();
+    mySynth.deleteRetiredVoices();
+
+    // the voices render RENDER_CHUNK_SIZE samples at a time whatever samplesPerBlock is,
+    // so their scratch buffers stay small and a host exceeding it is still safe;
+    // voices already prepared for this sample rate keep everything they have
+    for (int v = 0; v < mySynth.getNumAllocatedVoices(); ++v)
+    {
+        auto* voice = static_cast<SimpleSynthVoice*>(mySynth.getAllocatedVoice(v));
+        voice->setOversamplingFactor(voiceOversampling);
+        voice->setMaxNewtonIterations(voiceNewtonIterations);
+        voice->prepareToPlay(sampleRate, RENDER_CHUNK_SIZE);
+    }
+
+    // the pipeline restarts on the audio thread with the first block played ahead
+    renderingAhead = false;
+    renderAheadEngaged = false;
+    renderAhead.prepare(getTotalNumOutputChannels(), samplesPerBlock);
+    setLatencySamples(0);
+
+    profiler.prepare(sampleRate);
+}
+
+// hosts call this from any thread, possibly while the audio thread runs: the flag is only recorded.
+// The profile follows at the next prepareToPlay, or on the message thread for the hosts that do not
+// prepare again around a bounce
+void DemoSynthAudioProcessor::setNonRealtime(bool isNonRealtime) noexcept
+{
+    AudioProcessor::setNonRealtime(isNonRealtime);
+
+    renderModeChanged = true;
+    triggerAsyncUpdate();
 }
 
 void DemoSynthAudioProcessor::releaseResources()
 {
-    for (int v = 0; v < mySynth.getNumVoices(); ++v)
-        if (auto voice = dynamic_cast<SimpleSynthVoice*>(mySynth.getVoice(v)))
-            voice->releaseResources();
+    const ScopedLock sl(poolLock);
+
+    preparedSampleRate = 0.0;
+    renderAhead.stop();
+    renderingAhead = false;
+
+    mySynth.updateVoicePool();
+    mySynth.deleteRetiredVoices();
+
+    for (int v = 0; v < mySynth.getNumAllocatedVoices(); ++v)
+        static_cast<SimpleSynthVoice*>(mySynth.getAllocatedVoice(v))->releaseResources();
 }
 
 bool DemoSynthAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
@@ -55,15 +222,89 @@ bool DemoSynthAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts
 void DemoSynthAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
-    const auto numSamples = buffer.getNumSamples();
-    AudioPlayHead::CurrentPositionInfo hostPosition = retriveAudioPositionInfo(getPlayHead());
-    for (int v = 0; v < mySynth.getNumVoices(); ++v)
-        if (auto voice = dynamic_cast<SimpleSynthVoice*>(mySynth.getVoice(v)))
-            voice->updatePosition(hostPosition);
-    
+#if SUPERCORE_PROFILING
+    const auto blockStart = Profiling::readCycles();
+#endif
+    const auto position = retriveAudioPositionInfo(getPlayHead());
+
     buffer.clear();
 
+    // render-ahead delays everything played through the plugin, so it is for playback: never
+    // offline, and off while the host records. Whether the host monitors live input on an armed
+    // track cannot be told, the AHEAD parameter is what turns it off then. A block with more MIDI
+    // than a queued block can hold is rendered live
+    const bool ahead = parameterValues[Parameters::renderAhead]->load() > 0.5f
+                    && !isNonRealtime() && !position.isRecording
+                    && buffer.getNumSamples() <= renderAhead.getLatency()
+                    && RenderAhead::canQueue(midiMessages);
+
+    const bool enteringAhead = ahead && !renderingAhead;
+    const bool leavingAhead = renderingAhead && !ahead;
+
+    // the synth changes thread, the background one must be done with it
+    if (leavingAhead)
+        renderAhead.waitUntilIdle();
+
+    // the latency reported to the host follows on the timer
+    renderingAhead = ahead;
+    renderAheadEngaged = ahead;
+
+    // the block that enters the mode is still rendered live: the pipeline takes over from the next one
+    if (renderingAhead && !enteringAhead)
+    {
+        renderAhead.process(buffer, midiMessages, position);
+    }
+    else
+    {
+        renderSynth(buffer, midiMessages, position);
+
+        // the output rendered ahead for this block fades out against the live one
+        if (leavingAhead)
+            renderAhead.crossfadeOut(buffer);
+
+        renderAhead.recordLive(buffer);
+
+        // and the other way round, against the output played a latency earlier
+        if (enteringAhead)
+            renderAhead.crossfadeIn(buffer);
+    }
+
+#if SUPERCORE_PROFILING
+    profiler.endBlock(Profiling::readCycles() - blockStart, buffer.getNumSamples());
+#endif
+}
+
+// runs on the audio thread, or on the render-ahead thread when that mode is on
+void DemoSynthAudioProcessor::renderSynth(AudioBuffer<float>& buffer, const MidiBuffer& midiMessages, const AudioPlayHead::CurrentPositionInfo& position)
+{
+    juce::ScopedNoDenormals noDenormals;
+    const auto numSamples = buffer.getNumSamples();
+    hostPosition = position;
+
+    // voices joining the pool start from the values the others already have
+    const int previousNumVoices = mySynth.getNumVoices();
+    mySynth.updateVoicePool();
+
+    for (int v = previousNumVoices; v < mySynth.getNumVoices(); ++v)
+        for (int i = 0; i < Parameters::numParams; ++i)
+            static_cast<SimpleSynthVoice*>(mySynth.getVoice(v))->setParameter(i, appliedValues[i]);
+
+    const auto version = parameterVersion.load();
+    if (version != appliedVersion)
+    {
+        appliedVersion = version;
+        syncParameters();
+    }
+
+    // only sounding voices follow the host, the others read hostPosition when they start
+    for (int v = 0; v < mySynth.getNumActiveVoices(); ++v)
+        static_cast<SimpleSynthVoice*>(mySynth.getActiveVoice(v))->updatePosition(hostPosition);
+
     mySynth.renderNextBlock(buffer, midiMessages, 0, numSamples);
+
+#if SUPERCORE_PROFILING
+    profiler.setActiveVoices(mySynth.getNumActiveVoices());
+#endif
 }
 
 bool DemoSynthAudioProcessor::hasEditor() const
@@ -124,100 +365,39 @@ void DemoSynthAudioProcessor::setStateInformation (const void* data, int sizeInB
 
 void DemoSynthAudioProcessor::parameterChanged(const String& paramID, float newValue)
 {
-    for (int v = 0; v < mySynth.getNumVoices(); ++v)
-        if (auto voice = dynamic_cast<SimpleSynthVoice*>(mySynth.getVoice(v)))
+    // possibly on the audio thread, where posting a message could lock: the timer resizes the pool
+    if (paramID == Parameters::nameVoices)
+    {
+        targetVoices = roundToInt(newValue);
+        return;
+    }
+
+    if (paramID == Parameters::nameRenderThreads && newValue > 0.0f)
+        renderWorkersWanted = true;
+
+    ++parameterVersion;
+}
+
+void DemoSynthAudioProcessor::syncParameters()
+{
+    for (int i = 0; i < Parameters::numParams; ++i)
+    {
+        const float newValue = parameterValues[i]->load();
+
+        if (newValue == appliedValues[i])
+            continue;
+
+        appliedValues[i] = newValue;
+
+        if (i == Parameters::renderThreads || i == Parameters::parallelVoices)
         {
-            // OSC
-            if (paramID == Parameters::nameMainWf)
-                voice->setMainWf(newValue);
-            
-            if (paramID == Parameters::nameSawReg)
-                voice->setSawRegister(newValue);
-            
-            if (paramID == Parameters::nameSawNum)
-                voice->setSawNum(newValue);
-            
-            if (paramID == Parameters::nameDetune)
-                voice->setSawDetune(newValue);
-            
-            if (paramID == Parameters::nameStereoWidth)
-                voice->setSawStereoWidth(newValue);
-            
-            if (paramID == Parameters::namePhase)
-                voice->setPhaseResetting(newValue);
-            
-//            if (paramID == Parameters::namePhaseDegree)
-//                voice->setSawPhase(newValue);
-            
-            // OSC levels
-            if (paramID == Parameters::nameSawLev)
-                voice->setSawGain(Decibels::decibelsToGain(newValue, Parameters::dbFloor));
-
-            if (paramID == Parameters::nameSubLev)
-                voice->setSubGain(Decibels::decibelsToGain(newValue, Parameters::dbFloor));
-            
-            if (paramID == Parameters::nameNLev)
-                voice->setNoiseGain(Decibels::decibelsToGain(newValue, Parameters::dbFloor));
-            
-            // ADSR
-            if (paramID == Parameters::nameAtk)
-                voice->setAttack(newValue);
-
-            if (paramID == Parameters::nameDcy)
-                voice->setDecay(newValue);
-
-            if (paramID == Parameters::nameSus)
-                voice->setSustain(newValue);
-
-            if (paramID == Parameters::nameRel)
-                voice->setRelease(newValue);
-            
-            // SUB
-            if (paramID == Parameters::nameSubReg)
-                voice->setSubReg(roundToInt(newValue));
-            
-            if (paramID == Parameters::nameSubWf)
-                voice->setSubWf(roundToInt(newValue));
-            
-            // FILTER
-            if (paramID == Parameters::nameFiltHz)
-                voice->setCutoff(newValue);
-            
-            if (paramID == Parameters::nameFiltQ)
-                voice->setQuality(newValue);
-            
-            if (paramID == Parameters::nameNRel)
-                voice->setNoiseRelease(newValue);
-            
-            if (paramID == Parameters::nameNFilt)
-                voice->setNoiseFilterCutoff(newValue);
-                        
-            if (paramID == Parameters::nameFiltEnv)
-                voice->setFilterEnvAmt(newValue);
-            
-            // FILTER & LFO
-            if (paramID == Parameters::nameFiltLfoAmt)
-                voice->setFilterLfoAmt(newValue);
-            
-            if (paramID == Parameters::nameLfoWf)
-                voice->setLfoWf(newValue);
-            
-            if (paramID == Parameters::nameLfoFreq)
-                voice->setLfoFreq(newValue);
-            
-            if (paramID == Parameters::nameLfoRate)
-                voice->setLfoRate(newValue);
-            
-            if (paramID == Parameters::nameLfoSync)
-                voice->setLfoSync(newValue);
-            
-//            if (paramID == Parameters::nameOversampling)
-//                voice->setOversampling(newValue);
-            
-            if (paramID == Parameters::nameMaster)
-                voice->setMasterGain(newValue);
+            applyParallelRendering();
+            continue;
         }
 
+        for (int v = 0; v < mySynth.getNumVoices(); ++v)
+            static_cast<SimpleSynthVoice*>(mySynth.getVoice(v))->setParameter(i, newValue);
+    }
 }
 
 //==============================================================================
@@ -3,17 +3,21 @@
 #include "Synth.h"
 #include "PluginParameters.h"
 #include "PolySynth.h"
+#include "RenderAhead.h"
+#include "Profiling.h"
+#include "DspResources.h"
 
-class DemoSynthAudioProcessor  : public juce::AudioProcessor, public AudioProcessorValueTreeState::Listener
+class DemoSynthAudioProcessor  : public juce::AudioProcessor, public AudioProcessorValueTreeState::Listener, private AsyncUpdater, private Timer
 {
 public:
     DemoSynthAudioProcessor();
-    ~DemoSynthAudioProcessor() override {}
+    ~DemoSynthAudioProcessor() override;
 
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void setNonRealtime (bool isNonRealtime) noexcept override;
 
 //    juce::AudioProcessorEditor* createEditor() override { return nullptr; }
     juce::AudioProcessorEditor* createEditor() override;
@@ -38,14 +42,60 @@ public:
     //==============================================================================
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
+
+    // stage and block timings for the CPU panel, fed in SUPERCORE_PROFILING builds only
+    Profiling::Profiler& getProfiler() { return profiler; }
 //    void panic();
 
 private:
     void parameterChanged(const String& paramID, float newValue) override;
+    void syncParameters();
+    void renderSynth(AudioBuffer<float>& buffer, const MidiBuffer& midiMessages, const AudioPlayHead::CurrentPositionInfo& position);
+
+    // polyphony: voices are created and deleted on the message thread, never while rendering
+    void handleAsyncUpdate() override;
+    void timerCallback() override;
+    void updatePool();
+    SimpleSynthVoice* createVoice();
+    void createRenderWorkers();
+    void applyParallelRendering();
+
+    // the DSP tables of the voices are shared with the other instances while this is held
+    SharedResourcePointer<DspResources::Cache> sharedResources;
 
     AudioProcessorValueTreeState parameters;
 //    Synthesiser mySynth;
     PolySynthesiser mySynth;
+    AudioPlayHead::CurrentPositionInfo hostPosition;
+    std::atomic<int> targetVoices { Parameters::defaultVoices };
+    std::atomic<bool> renderWorkersWanted { false };  // THREADS has been above 0
+    int numVoicesSet = Parameters::defaultVoices;     // last count given to mySynth, under poolLock
+    CriticalSection poolLock;                         // the timer against prepareToPlay on another thread
+
+    // the listener only bumps the version, the audio thread reads the values once per block
+    // when it has changed and pushes the ones that differ from what the voices already have
+    std::atomic<float>* parameterValues[Parameters::numParams];
+    float appliedValues[Parameters::numParams];
+    std::atomic<uint32> parameterVersion { 1 };
+    uint32 appliedVersion = 0;
+    double preparedSampleRate = 0.0;
+
+    // offline rendering: the bounce profile of the state is in use, set by prepareToPlay
+    bool bouncing = false;
+    std::atomic<bool> renderModeChanged { false };  // set by setNonRealtime, for the message thread
+    Parameters::BounceProfile bounceProfile;
+    int voiceOversampling = Parameters::realtimeOversampling;
+    int voiceNewtonIterations = Parameters::realtimeNewtonIterations;
+    // the process-wide pool, held from the first time parallel rendering is switched on until the processor goes
+    std::unique_ptr<SharedResourcePointer<RenderWorkers>> renderWorkers;
+
+    // render-ahead: the synth is rendered by the background thread while renderingAhead is set
+    RenderAhead renderAhead { [this] (AudioBuffer<float>& output, const MidiBuffer& midi, const AudioPlayHead::CurrentPositionInfo& position)
+                              { renderSynth(output, midi, position); } };
+    bool renderingAhead = false;                  // audio thread
+    std::atomic<bool> renderAheadEngaged { false };  // read by the message thread for the latency
+
+    Profiling::Profiler profiler;
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DemoSynthAudioProcessor)
@@ -10,8 +10,61 @@
 
 #pragma once
 #include <JuceHeader.h>
+#include "RenderWorkers.h"
 
 #define DEFAULT_STEAL 2;
+#define MAX_POLYPHONY 64
+#define MAX_HELD_KEYS 128
+#define RENDER_CHUNK_SIZE 64
+
+// base class of the voices played by PolySynthesiser: the note bookkeeping is written
+// by the engine on the audio thread, the voice only renders and clears its note at the end of the tail
+class SynthVoice
+{
+public:
+    SynthVoice() {}
+    virtual ~SynthVoice() {}
+
+    virtual void startNote(int midiNoteNumber, float velocity, int currentPitchWheelPosition) = 0;
+    virtual void stopNote(float velocity, bool allowTailOff) = 0;
+    virtual void pitchWheelMoved(int newPitchWheelValue) {}
+    virtual void controllerMoved(int controllerNumber, int newControllerValue) {}
+    virtual void renderNextBlock(AudioBuffer<float>& outputBuffer, int startSample, int numSamples) = 0;
+
+    bool isVoiceActive() const { return currentlyPlayingNote >= 0; }
+    int getCurrentlyPlayingNote() const { return currentlyPlayingNote; }
+    bool isPlayingChannel(int midiChannel) const { return currentPlayingMidiChannel == midiChannel; }
+
+    // value of the engine's note-on counter when the current note started
+    uint32 getNoteOnTime() const { return noteOnTime; }
+
+    // loudness of the last rendered range (any monotonic measure), used to steal the quietest voice
+    virtual float getCurrentLevel() const { return 1.0f; }
+
+    bool isKeyDown() const { return keyIsDown; }
+    bool isSustainPedalDown() const { return sustainPedalDown; }
+    bool isSostenutoPedalDown() const { return sostenutoPedalDown; }
+
+protected:
+    // the voice calls this when its tail has ended, it is free again for a new note
+    void clearCurrentNote()
+    {
+        currentlyPlayingNote = -1;
+    }
+
+private:
+    friend class PolySynthesiser;
+
+    int currentlyPlayingNote = -1;
+    int currentPlayingMidiChannel = 0;
+    uint32 noteOnTime = 0;
+    int renderPosition = 0;      // first sample of the current chunk not rendered yet, from the chunk start
+    bool keyIsDown = false;
+    bool sustainPedalDown = false;
+    bool sostenutoPedalDown = false;
+
+    JUCE_DECLARE_NON_COPYABLE(SynthVoice)
+};
 
 class KeysHistory
 {
@@ -22,28 +75,33 @@ public:
     void press(const MidiMessage m)
     {
         lastVelocity = m.getFloatVelocity();
-        keysPressed.push_back(m.getNoteNumber());
+
+        if (numKeys < MAX_HELD_KEYS)
+            keysPressed[numKeys++] = m.getNoteNumber();
     }
 
     void release(const MidiMessage m)
     {
-        auto releasedKeys = std::find(keysPressed.begin(), keysPressed.end(), m.getNoteNumber());
-
         if (any())
         {
-            if (releasedKeys != std::end(keysPressed))
-                keysPressed.erase(releasedKeys);
+            auto releasedKey = std::find(keysPressed, keysPressed + numKeys, m.getNoteNumber());
+
+            if (releasedKey != keysPressed + numKeys)
+            {
+                std::copy(releasedKey + 1, keysPressed + numKeys, releasedKey);
+                --numKeys;
+            }
             else
             {
                 DBG("Released key not found in keypressed log, releasing all keys");
-                keysPressed.clear();
+                numKeys = 0;
             }
         }
     }
 
     bool newEventReady(const int threshold)
     {
-        return (keysPressed.size() <= threshold) || (lastEventProvided != getCandidate());
+        return (numKeys <= threshold) || (lastEventProvided != getCandidate());
     }
 
     int getNewEvent()
@@ -58,12 +116,12 @@ public:
 
     void releaseAll()
     {
-        if (any()) keysPressed.clear();
+        numKeys = 0;
     }
 
     bool any()
     {
-        return !keysPressed.empty();
+        return numKeys > 0;
     }
 
     void setStealing(int criterion)
@@ -80,16 +138,16 @@ private:
         switch (stealCriterion)
         {
         case 0: // "Lowest"
-            nn = *std::min_element(keysPressed.begin(), keysPressed.end());
+            nn = *std::min_element(keysPressed, keysPressed + numKeys);
             break;
         case 1: // "Highest"
-            nn = *std::max_element(keysPressed.begin(), keysPressed.end());
+            nn = *std::max_element(keysPressed, keysPressed + numKeys);
             break;
         case 2: // "Oldest"
-            nn = keysPressed.front();
+            nn = keysPressed[0];
             break;
         case 3: // "Newest"
-            nn = keysPressed.back();
+            nn = keysPressed[numKeys - 1];
             break;
         default:
             break;
@@ -98,27 +156,227 @@ private:
         return nn;
     }
 
-    std::vector<int> keysPressed;
+    // keys in the order they were pressed
+    int keysPressed[MAX_HELD_KEYS] = { 0 };
+    int numKeys = 0;
     int lastEventProvided = -1000;
     float lastVelocity = 1.0f;
     int stealCriterion = DEFAULT_STEAL;
 };
 
-class PolySynthesiser : public Synthesiser
+// Voice allocator and MIDI dispatcher. Everything on the audio thread works on fixed-size
+// arrays, without locks and without heap traffic; the only thing shared with the message
+// thread is the size of the voice pool, handed over through an atomic.
+class PolySynthesiser
 {
 public:
-    PolySynthesiser() = default;
-    ~PolySynthesiser() = default;
+    PolySynthesiser()
+    {
+        std::fill(std::begin(lastPitchWheelValues), std::end(lastPitchWheelValues), 0x2000);
+
+        for (auto& voiceOutput : voiceOutputs)
+            voiceOutput.setSize(2, RENDER_CHUNK_SIZE);
+    }
+
+    virtual ~PolySynthesiser()
+    {
+        for (int i = 0; i < numAllocatedVoices; ++i)
+            delete voices[i];
+    }
 
     void setStealing(int criterion)
     {
         stealCriterion = criterion;
     }
 
-    void noteOn(int midiChannel, int midiNoteNumber, float velocity) override
+    //==============================================================================
+    // MESSAGE THREAD
+
+    // grows or shrinks the pool: new voices come from createVoice() ready to play,
+    // the audio thread adopts the new size at the start of its next block
+    template <typename VoiceFactory>
+    void setNumVoices(int newNumVoices, VoiceFactory&& createVoice)
+    {
+        newNumVoices = jlimit(0, MAX_POLYPHONY, newNumVoices);
+
+        // voices removed earlier but not deleted yet are simply taken back
+        while (numAllocatedVoices < newNumVoices)
+            voices[numAllocatedVoices++] = createVoice();
+
+        numPoolVoices = newNumVoices;
+
+        const uint32 generation = (publishedPool.load(std::memory_order_relaxed) >> 8) + 1;
+        publishedPool.store((generation << 8) | (uint32)newNumVoices, std::memory_order_release);
+    }
+
+    // deletes the removed voices once the audio thread has adopted the latest pool,
+    // returns false while some of them are still waiting
+    bool deleteRetiredVoices()
+    {
+        if (numAllocatedVoices == numPoolVoices)
+            return true;
+
+        if (adoptedPool.load(std::memory_order_acquire) != publishedPool.load(std::memory_order_relaxed))
+            return false;
+
+        while (numAllocatedVoices > numPoolVoices)
+        {
+            delete voices[--numAllocatedVoices];
+            voices[numAllocatedVoices] = nullptr;
+        }
+
+        return true;
+    }
+
+    // every voice owned by the pool, the removed ones not yet deleted included:
+    // for prepareToPlay() and releaseResources(), while the audio thread is not running
+    int getNumAllocatedVoices() const
+    {
+        return numAllocatedVoices;
+    }
+
+    SynthVoice* getAllocatedVoice(int index) const
+    {
+        return voices[index];
+    }
+
+    // the workers stay owned by the caller, who must not delete them while the audio thread runs
+    void setRenderWorkers(RenderWorkers* newWorkers)
+    {
+        renderWorkers.store(newWorkers);
+    }
+
+    //==============================================================================
+    // AUDIO THREAD
+
+    // with maxThreads workers or more, chunks with at least minimumVoices active voices
+    // are rendered in parallel; maxThreads = 0 keeps everything on the audio thread
+    void setParallelRendering(int maxThreads, int minimumVoices)
+    {
+        parallelThreads = maxThreads;
+        parallelMinimumVoices = jmax(2, minimumVoices);
+    }
+
+    // adopts the latest pool size, the voices beyond it are cut and left alone from now on
+    void updateVoicePool()
+    {
+        const uint32 pool = publishedPool.load(std::memory_order_acquire);
+
+        if (pool == adoptedPool.load(std::memory_order_relaxed))
+            return;
+
+        const int newNumVoices = (int)(pool & 0xff);
+
+        for (int i = newNumVoices; i < numVoices; ++i)
+        {
+            if (voices[i]->isVoiceActive())
+                stopVoice(voices[i], 0.0f, false);
+
+            removeFromActiveVoices(voices[i]);
+        }
+
+        numVoices = newNumVoices;
+        adoptedPool.store(pool, std::memory_order_release);
+    }
+
+    // voices of the pool adopted by the audio thread
+    int getNumVoices() const
+    {
+        return numVoices;
+    }
+
+    SynthVoice* getVoice(int index) const
+    {
+        return voices[index];
+    }
+
+    // voices that are currently sounding, oldest first
+    int getNumActiveVoices() const
+    {
+        return numActiveVoices;
+    }
+
+    SynthVoice* getActiveVoice(int index) const
+    {
+        return activeVoices[index];
+    }
+
+    // the block is rendered in chunks of RENDER_CHUNK_SIZE samples. The block is not split at the
+    // MIDI events: an event only brings the voices it touches up to its sample offset before it is
+    // applied, every other voice renders the whole chunk in one call, however dense the MIDI is.
+    // Voices see each chunk as a buffer of its own, so their scratch memory is sized to the chunk
+    // whatever the host block size
+    void renderNextBlock(AudioBuffer<float>& outputAudio, const MidiBuffer& midiData, int startSample, int numSamples)
+    {
+        updateVoicePool();
+
+        auto midiIterator = midiData.findNextSamplePosition(startSample);
+        const auto midiEnd = midiData.end();
+        const int endSample = startSample + numSamples;
+
+        currentOutput = &chunkOutput;
+
+        for (int chunkStart = startSample; chunkStart < endSample; chunkStart += RENDER_CHUNK_SIZE)
+        {
+            const int chunkLength = jmin(RENDER_CHUNK_SIZE, endSample - chunkStart);
+
+            chunkOutput.setDataToReferTo(outputAudio.getArrayOfWritePointers(), outputAudio.getNumChannels(), chunkStart, chunkLength);
+
+            for (int i = 0; i < numActiveVoices; ++i)
+                activeVoices[i]->renderPosition = 0;
+
+            for (; midiIterator != midiEnd; ++midiIterator)
+            {
+                const auto metadata = *midiIterator;
+
+                if (metadata.samplePosition >= chunkStart + chunkLength)
+                    break;
+
+                eventPosition = jmax(metadata.samplePosition - chunkStart, 0);
+                handleMidiEvent(metadata.getMessage());
+            }
+
+            renderVoices(chunkOutput, chunkLength);
+        }
+
+        // events falling after the end of the block, there is nothing left to render
+        currentOutput = nullptr;
+        for (; midiIterator != midiEnd; ++midiIterator)
+            handleMidiEvent((*midiIterator).getMessage());
+    }
+
+    virtual void handleMidiEvent(const MidiMessage& m)
+    {
+        const int channel = m.getChannel();
+
+        if (m.isNoteOn())
+        {
+            noteOn(channel, m.getNoteNumber(), m.getFloatVelocity());
+        }
+        else if (m.isNoteOff())
+        {
+            noteOff(channel, m.getNoteNumber(), m.getFloatVelocity(), true);
+        }
+        else if (m.isAllNotesOff() || m.isAllSoundOff())
+        {
+            allNotesOff(channel, true);
+        }
+        else if (m.isPitchWheel())
+        {
+            const int wheelPos = m.getPitchWheelValue();
+            lastPitchWheelValues[channel - 1] = wheelPos;
+            handlePitchWheel(channel, wheelPos);
+        }
+        else if (m.isController())
+        {
+            handleController(channel, m.getControllerNumber(), m.getControllerValue());
+        }
+    }
+
+    void noteOn(int midiChannel, int midiNoteNumber, float velocity)
     {
         // First, find a free voice
-        SynthesiserVoice* voice = findFreeVoice(getSound(0).get(), false, midiNoteNumber, midiChannel);
+        SynthVoice* voice = findFreeVoice();
 
         if (voice == nullptr)
         {
@@ -129,68 +387,330 @@ public:
         if (voice != nullptr)
         {
             stopVoice(voice, 1.0f, true); // Hard cut previous note
-            startVoice(voice, getSound(0).get(), midiChannel, midiNoteNumber, velocity);
+            startVoice(voice, midiChannel, midiNoteNumber, velocity);
+            voice->renderPosition = eventPosition;
+
+            // a stolen voice moves to the end of the list, being now the newest one
+            removeFromActiveVoices(voice);
+            if (voice->isVoiceActive())
+                activeVoices[numActiveVoices++] = voice;
         }
     }
 
+    void noteOff(int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff)
+    {
+        for (int i = 0; i < numVoices; ++i)
+        {
+            auto* voice = voices[i];
+
+            if (voice->getCurrentlyPlayingNote() == midiNoteNumber && voice->isPlayingChannel(midiChannel) && voice->isKeyDown())
+            {
+                voice->keyIsDown = false;
+
+                if (!(voice->isSustainPedalDown() || voice->isSostenutoPedalDown()))
+                    stopVoice(voice, velocity, allowTailOff);
+            }
+        }
+    }
+
+    void allNotesOff(int midiChannel, bool allowTailOff)
+    {
+        for (int i = 0; i < numVoices; ++i)
+            if (midiChannel <= 0 || voices[i]->isPlayingChannel(midiChannel))
+            {
+                renderUpToEvent(voices[i]);
+                voices[i]->stopNote(1.0f, allowTailOff);
+            }
+
+        std::fill(std::begin(sustainPedalsDown), std::end(sustainPedalsDown), false);
+    }
+
     void panic()
     {
         allNotesOff(0, false);
     }
 
-private:
-    int stealCriterion = 2; // Default to "Oldest"
-
-    SynthesiserVoice* selectVoiceToSteal()
+protected:
+    // completes the chunk: only the voices in the active list are rendered, from where each of them
+    // has arrived to the end of the chunk. Idle voices cost nothing, voices that have finished
+    // their tail leave the list
+    virtual void renderVoices(AudioBuffer<float>& outputAudio, int chunkEnd)
     {
-        int targetNote = -1;
-        SynthesiserVoice* selected = nullptr;
+        auto* workers = renderWorkers.load();
+
+        if (workers != nullptr && parallelThreads > 0 && numActiveVoices >= parallelMinimumVoices)
+            renderVoicesInParallel(*workers, outputAudio, chunkEnd);
 
-        std::vector<std::pair<int, SynthesiserVoice*>> candidates;
+        int kept = 0;
 
-        for (auto* v : voices)
+        for (int i = 0; i < numActiveVoices; ++i)
         {
-            if (v->isVoiceActive())
+            auto* voice = activeVoices[i];
+
+            // after a parallel pass every voice is already at chunkEnd
+            if (voice->isVoiceActive() && voice->renderPosition < chunkEnd)
+                voice->renderNextBlock(outputAudio, voice->renderPosition, chunkEnd - voice->renderPosition);
+
+            voice->renderPosition = chunkEnd;
+
+            if (voice->isVoiceActive())
+                activeVoices[kept++] = voice;
+        }
+
+        numActiveVoices = kept;
+    }
+
+    void handlePitchWheel(int midiChannel, int wheelValue)
+    {
+        for (int i = 0; i < numVoices; ++i)
+            if (voices[i]->isPlayingChannel(midiChannel))
             {
-                candidates.emplace_back(v->getCurrentlyPlayingNote(), v);
+                renderUpToEvent(voices[i]);
+                voices[i]->pitchWheelMoved(wheelValue);
             }
+    }
+
+    void handleController(int midiChannel, int controllerNumber, int controllerValue)
+    {
+        switch (controllerNumber)
+        {
+        case 0x40: handleSustainPedal(midiChannel, controllerValue >= 64); break;
+        case 0x42: handleSostenutoPedal(midiChannel, controllerValue >= 64); break;
+        default: break;
         }
 
-        if (candidates.empty()) return nullptr;
+        for (int i = 0; i < numVoices; ++i)
+            if (voices[i]->isPlayingChannel(midiChannel))
+            {
+                renderUpToEvent(voices[i]);
+                voices[i]->controllerMoved(controllerNumber, controllerValue);
+            }
+    }
 
-        switch (stealCriterion)
+    int lastPitchWheelValues[16];
+
+private:
+    int stealCriterion = 4; // Default to "Quietest"
+
+    // pool: slots [0, numAllocatedVoices) are owned, the message thread appends and deletes
+    // only beyond what the audio thread can see, i.e. beyond numVoices
+    SynthVoice* voices[MAX_POLYPHONY] = { nullptr };
+    int numAllocatedVoices = 0;
+    int numPoolVoices = 0;                   // message thread
+    int numVoices = 0;                       // audio thread
+    // pool size in the low byte, a generation counter above it
+    std::atomic<uint32> publishedPool { 0 };
+    std::atomic<uint32> adoptedPool { 0 };
+
+    SynthVoice* activeVoices[MAX_POLYPHONY] = { nullptr };
+    int numActiveVoices = 0;
+
+    // parallel rendering: each active voice renders the rest of the chunk into its own buffer,
+    // the buffers are then summed in the order of the active list, so the result does not
+    // depend on which thread rendered what (and matches the serial rendering)
+    std::atomic<RenderWorkers*> renderWorkers { nullptr };
+    int parallelThreads = 0;
+    int parallelMinimumVoices = 8;
+    AudioBuffer<float> voiceOutputs[MAX_POLYPHONY];
+    int jobStart[MAX_POLYPHONY] = { 0 };
+    int jobEnd = 0;
+
+    // chunk being rendered (it refers to the host buffer) and offset of the MIDI event being handled in it
+    AudioBuffer<float> chunkOutput;
+    AudioBuffer<float>* currentOutput = nullptr;
+    int eventPosition = 0;
+
+    uint32 lastNoteOnCounter = 0;
+    bool sustainPedalsDown[17] = { false };
+
+    SynthVoice* findFreeVoice() const
+    {
+        for (int i = 0; i < numVoices; ++i)
+            if (!voices[i]->isVoiceActive())
+                return voices[i];
+
+        return nullptr;
+    }
+
+    SynthVoice* selectVoiceToSteal() const
+    {
+        SynthVoice* selected = nullptr;
+
+        for (int i = 0; i < numVoices; ++i)
         {
-        case 0: // Lowest
-            selected = std::min_element(candidates.begin(), candidates.end(),
-                [](auto& a, auto& b) { return a.first < b.first; })->second;
-            break;
+            auto* v = voices[i];
 
-        case 1: // Highest
-            selected = std::max_element(candidates.begin(), candidates.end(),
-                [](auto& a, auto& b) { return a.first < b.first; })->second;
-            break;
+            if (!v->isVoiceActive())
+                continue;
 
-        case 2: // Oldest
-            for (auto* v : voices)
+            if (selected == nullptr)
             {
-                if (v->isVoiceActive())
-                    return v; // return the first active voice (oldest)
+                selected = v;
+                continue;
             }
-            break;
 
-        case 3: // Newest
-                for (int i = voices.size(); --i >= 0;)
-                {
-                    auto* v = voices[i];
-                    if (v->isVoiceActive())
-                        return v; // Newest (last active voice)
-                }
-
-            break;
+            switch (stealCriterion)
+            {
+            case 0: // Lowest
+                if (v->getCurrentlyPlayingNote() < selected->getCurrentlyPlayingNote())
+                    selected = v;
+                break;
+
+            case 1: // Highest
+                if (v->getCurrentlyPlayingNote() > selected->getCurrentlyPlayingNote())
+                    selected = v;
+                break;
+
+            case 2: // Oldest
+                if (v->getNoteOnTime() < selected->getNoteOnTime())
+                    selected = v;
+                break;
+
+            case 3: // Newest
+                if (v->getNoteOnTime() > selected->getNoteOnTime())
+                    selected = v;
+                break;
+
+            case 4: // Quietest, the oldest among equally quiet ones
+                if (v->getCurrentLevel() < selected->getCurrentLevel()
+                    || (v->getCurrentLevel() == selected->getCurrentLevel() && v->getNoteOnTime() < selected->getNoteOnTime()))
+                    selected = v;
+                break;
+
+            default:
+                break;
+            }
         }
 
         return selected;
     }
+
+    void startVoice(SynthVoice* voice, int midiChannel, int midiNoteNumber, float velocity)
+    {
+        voice->currentlyPlayingNote = midiNoteNumber;
+        voice->currentPlayingMidiChannel = midiChannel;
+        voice->noteOnTime = ++lastNoteOnCounter;
+        voice->keyIsDown = true;
+        voice->sostenutoPedalDown = false;
+        voice->sustainPedalDown = sustainPedalsDown[midiChannel];
+
+        voice->startNote(midiNoteNumber, velocity, lastPitchWheelValues[midiChannel - 1]);
+    }
+
+    void stopVoice(SynthVoice* voice, float velocity, bool allowTailOff)
+    {
+        renderUpToEvent(voice);
+        voice->stopNote(velocity, allowTailOff);
+    }
+
+    void renderVoicesInParallel(RenderWorkers& workers, AudioBuffer<float>& outputAudio, int chunkEnd)
+    {
+        jassert(outputAudio.getNumChannels() <= 2);
+
+        jobEnd = chunkEnd;
+
+        for (int i = 0; i < numActiveVoices; ++i)
+            jobStart[i] = activeVoices[i]->isVoiceActive() ? jmin(activeVoices[i]->renderPosition, chunkEnd) : chunkEnd;
+
+        workers.run(numActiveVoices, parallelThreads, renderVoiceJob, this);
+
+        for (int i = 0; i < numActiveVoices; ++i)
+        {
+            if (jobStart[i] < chunkEnd)
+                for (int ch = 0; ch < outputAudio.getNumChannels(); ++ch)
+                    outputAudio.addFrom(ch, jobStart[i], voiceOutputs[i], ch, jobStart[i], chunkEnd - jobStart[i]);
+
+            activeVoices[i]->renderPosition = chunkEnd;
+        }
+    }
+
+    static void renderVoiceJob(void* context, int index)
+    {
+        auto& synth = *static_cast<PolySynthesiser*>(context);
+        const int start = synth.jobStart[index];
+        const int numSamples = synth.jobEnd - start;
+
+        if (numSamples <= 0)
+            return;
+
+        auto& voiceOutput = synth.voiceOutputs[index];
+        voiceOutput.clear(start, numSamples);
+        synth.activeVoices[index]->renderNextBlock(voiceOutput, start, numSamples);
+    }
+
+    // a sounding voice catches up with the event before the event changes its state
+    void renderUpToEvent(SynthVoice* voice)
+    {
+        if (currentOutput == nullptr)
+            return;
+
+        if (voice->isVoiceActive() && voice->renderPosition < eventPosition)
+            voice->renderNextBlock(*currentOutput, voice->renderPosition, eventPosition - voice->renderPosition);
+
+        voice->renderPosition = jmax(voice->renderPosition, eventPosition);
+    }
+
+    void removeFromActiveVoices(SynthVoice* voice)
+    {
+        auto position = std::find(activeVoices, activeVoices + numActiveVoices, voice);
+
+        if (position != activeVoices + numActiveVoices)
+        {
+            std::copy(position + 1, activeVoices + numActiveVoices, position);
+            --numActiveVoices;
+        }
+    }
+
+    void handleSustainPedal(int midiChannel, bool isDown)
+    {
+        for (int i = 0; i < numVoices; ++i)
+        {
+            auto* voice = voices[i];
+
+            if (!voice->isPlayingChannel(midiChannel))
+                continue;
+
+            if (isDown)
+            {
+                if (voice->isKeyDown())
+                    voice->sustainPedalDown = true;
+            }
+            else
+            {
+                voice->sustainPedalDown = false;
+
+                if (!(voice->isKeyDown() || voice->isSostenutoPedalDown()))
+                    stopVoice(voice, 1.0f, true);
+            }
+        }
+
+        sustainPedalsDown[midiChannel] = isDown;
+    }
+
+    void handleSostenutoPedal(int midiChannel, bool isDown)
+    {
+        for (int i = 0; i < numVoices; ++i)
+        {
+            auto* voice = voices[i];
+
+            if (!voice->isPlayingChannel(midiChannel))
+                continue;
+
+            if (isDown)
+            {
+                voice->sostenutoPedalDown = true;
+            }
+            else if (voice->isSostenutoPedalDown())
+            {
+                voice->sostenutoPedalDown = false;
+
+                if (!(voice->isKeyDown() || voice->isSustainPedalDown()))
+                    stopVoice(voice, 1.0f, true);
+            }
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE(PolySynthesiser)
 };
 
 class MonoSynthesiser : public PolySynthesiser
@@ -223,27 +743,9 @@ public:
             allNotesOff(channel, true);
             pressedKeys.releaseAll();
         }
-        else if (m.isPitchWheel())
-        {
-            const int wheelPos = m.getPitchWheelValue();
-            lastPitchWheelValues[channel - 1] = wheelPos;
-            handlePitchWheel(channel, wheelPos);
-        }
-        else if (m.isAftertouch())
-        {
-            handleAftertouch(channel, m.getNoteNumber(), m.getAfterTouchValue());
-        }
-        else if (m.isChannelPressure())
+        else
         {
-            handleChannelPressure(channel, m.getChannelPressureValue());
-        }
-        else if (m.isController())
-        {
-            handleController(channel, m.getControllerNumber(), m.getControllerValue());
-        }
-        else if (m.isProgramChange())
-        {
-            handleProgramChange(channel, m.getProgramChangeNumber());
+            PolySynthesiser::handleMidiEvent(m);
         }
     }
 
@@ -263,5 +765,3 @@ private:
     KeysHistory pressedKeys;
 
 };
-
-
@@ -0,0 +1,249 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Hot-path instrumentation. With SUPERCORE_PROFILING=1 in the preprocessor definitions the voice
+// stages and processBlock are timed with the CPU cycle counter, and the editor shows a CPU panel.
+// Without it the timers compile to nothing and the Profiler is never fed.
+#ifndef SUPERCORE_PROFILING
+ #define SUPERCORE_PROFILING 0
+#endif
+
+#if SUPERCORE_PROFILING && JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+namespace Profiling
+{
+    // stages of SimpleSynthVoice::renderNextBlock, in order
+    enum Stage
+    {
+        modulation = 0, saws, decimator, sub, noise, mixer, filter, amp,
+        numStages
+    };
+
+    static const char* const stageNames[numStages] = {
+        "Mod", "Saws", "Decim", "Sub", "Noise", "Mixer", "Filter", "Amp"
+    };
+
+    // Newton-Raphson iterations of a ladder sample: 0 to 6 one by one, then 7 to 100,
+    // then the solves beyond the real-time iteration cap of Matrix
+    static const int numNewtonBins = 9;
+
+    static inline int newtonBin(int iterations)
+    {
+        return iterations > 100 ? numNewtonBins - 1 : jmin(iterations, numNewtonBins - 2);
+    }
+
+    // TSC on x86, the virtual counter on 64 bit ARM, the high resolution ticks elsewhere
+    static inline uint64 readCycles() noexcept
+    {
+       #if SUPERCORE_PROFILING && JUCE_INTEL
+        return (uint64)__rdtsc();
+       #elif SUPERCORE_PROFILING && JUCE_ARM && JUCE_64BIT && !JUCE_MSVC
+        uint64 ticks;
+        asm volatile ("mrs %0, cntvct_el0" : "=r" (ticks));
+        return ticks;
+       #else
+        return (uint64)Time::getHighResolutionTicks();
+       #endif
+    }
+
+    // what the CPU panel shows, one every publishInterval seconds of audio
+    struct Snapshot
+    {
+        float stageShare[numStages] {};         // of the cycles spent in the voice stages
+        float worstBlockMs = 0.0f;              // longest processBlock of the interval
+        float worstDeadlineMs = 0.0f;           // duration of the audio of that block
+        float load = 0.0f;                      // time spent in processBlock / duration of the audio
+        int activeVoices = 0;
+        uint32 newtonIterations[numNewtonBins] {}; // ladder samples per iteration count
+    };
+
+    class Profiler
+    {
+    public:
+        Profiler()
+        {
+            for (auto& cycles : stageCycles)
+                cycles = 0;
+            for (auto& count : newtonCounts)
+                count = 0;
+        }
+
+        // message thread, before playback: the counter is calibrated against the high resolution
+        // ticks from here on, so that cycles can be shown as milliseconds
+        void prepare(double newSampleRate)
+        {
+            sampleRate = newSampleRate;
+            calibrationCycles = readCycles();
+            calibrationTicks = Time::getHighResolutionTicks();
+            resetInterval();
+            fifo.reset();
+        }
+
+        // voices, from the audio thread or a render worker
+        void addStageCycles(const int stage, const uint64 cycles) noexcept
+        {
+            stageCycles[stage].fetch_add(cycles, std::memory_order_relaxed);
+        }
+
+        // the counts are added and cleared
+        void addNewtonIterations(uint32* counts) noexcept
+        {
+            for (int bin = 0; bin < numNewtonBins; ++bin)
+            {
+                if (counts[bin] != 0)
+                    newtonCounts[bin].fetch_add(counts[bin], std::memory_order_relaxed);
+                counts[bin] = 0;
+            }
+        }
+
+        // whichever thread renders the synth, the audio one or the render-ahead one
+        void setActiveVoices(const int numVoices) noexcept
+        {
+            activeVoices.store(numVoices, std::memory_order_relaxed);
+        }
+
+        // audio thread, at the end of every processBlock; publishes a Snapshot when the interval is over
+        void endBlock(const uint64 blockCycles, const int numSamples) noexcept
+        {
+            if (sampleRate <= 0.0)
+                return;
+
+            intervalCycles += blockCycles;
+            intervalSamples += numSamples;
+
+            // the worst block is the one closest to its deadline, not the longest one
+            if (blockCycles * (uint64)worstSamples >= worstCycles * (uint64)numSamples)
+            {
+                worstCycles = blockCycles;
+                worstSamples = numSamples;
+            }
+
+            if (intervalSamples < sampleRate * publishInterval)
+                return;
+
+            publish();
+            resetInterval();
+        }
+
+        // message thread: the latest Snapshot, false if nothing was published since the last call
+        bool pull(Snapshot& snapshot)
+        {
+            bool pulled = false;
+
+            while (fifo.getNumReady() > 0)
+            {
+                int start1, size1, start2, size2;
+                fifo.prepareToRead(1, start1, size1, start2, size2);
+                snapshot = snapshots[size1 > 0 ? start1 : start2];
+                fifo.finishedRead(1);
+                pulled = true;
+            }
+
+            return pulled;
+        }
+
+    private:
+        void publish() noexcept
+        {
+            Snapshot snapshot;
+
+            uint64 totalStageCycles = 0;
+            uint64 cycles[numStages];
+            for (int stage = 0; stage < numStages; ++stage)
+            {
+                cycles[stage] = stageCycles[stage].exchange(0, std::memory_order_relaxed);
+                totalStageCycles += cycles[stage];
+            }
+
+            for (int stage = 0; stage < numStages; ++stage)
+                snapshot.stageShare[stage] = totalStageCycles > 0 ? (float)cycles[stage] / (float)totalStageCycles : 0.0f;
+
+            for (int bin = 0; bin < numNewtonBins; ++bin)
+                snapshot.newtonIterations[bin] = newtonCounts[bin].exchange(0, std::memory_order_relaxed);
+
+            // cycles per second since prepare, one division per interval
+            const double seconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - calibrationTicks);
+            const double cyclesPerMs = seconds > 0.0 ? (double)(readCycles() - calibrationCycles) / (seconds * 1000.0) : 0.0;
+
+            if (cyclesPerMs > 0.0)
+            {
+                snapshot.worstBlockMs = (float)(worstCycles / cyclesPerMs);
+                snapshot.load = (float)((intervalCycles / cyclesPerMs) / (intervalSamples * 1000.0 / sampleRate));
+            }
+            snapshot.worstDeadlineMs = (float)(worstSamples * 1000.0 / sampleRate);
+            snapshot.activeVoices = activeVoices.load(std::memory_order_relaxed);
+
+            // the panel is behind: this interval is dropped, the next one will get through
+            if (fifo.getFreeSpace() == 0)
+                return;
+
+            int start1, size1, start2, size2;
+            fifo.prepareToWrite(1, start1, size1, start2, size2);
+            snapshots[size1 > 0 ? start1 : start2] = snapshot;
+            fifo.finishedWrite(1);
+        }
+
+        void resetInterval() noexcept
+        {
+            intervalCycles = 0;
+            intervalSamples = 0;
+            worstCycles = 0;
+            worstSamples = 1;
+        }
+
+        static constexpr double publishInterval = 0.1;
+        static const int fifoSize = 8;
+
+        std::atomic<uint64> stageCycles[numStages];
+        std::atomic<uint32> newtonCounts[numNewtonBins];
+        std::atomic<int> activeVoices { 0 };
+
+        // audio thread
+        double sampleRate = 0.0;
+        uint64 calibrationCycles = 0;
+        int64 calibrationTicks = 0;
+        uint64 intervalCycles = 0;
+        int intervalSamples = 0;
+        uint64 worstCycles = 0;
+        int worstSamples = 1;
+
+        // single producer (audio thread), single consumer (message thread)
+        AbstractFifo fifo { fifoSize };
+        Snapshot snapshots[fifoSize];
+
+        JUCE_DECLARE_NON_COPYABLE(Profiler)
+    };
+
+#if SUPERCORE_PROFILING
+    // adds the cycles spent in its scope to a stage
+    class ScopedStage
+    {
+    public:
+        ScopedStage(Profiler* p, const int s) noexcept
+            : profiler(p), stage(s), start(readCycles())
+        {}
+
+        ~ScopedStage()
+        {
+            if (profiler != nullptr)
+                profiler->addStageCycles(stage, readCycles() - start);
+        }
+
+    private:
+        Profiler* profiler;
+        const int stage;
+        const uint64 start;
+    };
+
+ #define SUPERCORE_PROFILE_STAGE(profiler, stage) \
+    const Profiling::ScopedStage JUCE_JOIN_MACRO(profiledStage, __LINE__) (profiler, Profiling::stage)
+#else
+ #define SUPERCORE_PROFILE_STAGE(profiler, stage)
+#endif
+}
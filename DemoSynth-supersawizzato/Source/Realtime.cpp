@@ -0,0 +1,151 @@
+/*
+  ==============================================================================
+
+    Realtime.cpp
+    Platform side of the wake-ups and of the scheduling shared between the
+    audio thread and its helper threads.
+
+  ==============================================================================
+*/
+
+#include "Realtime.h"
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#else
+ #include <semaphore.h>
+ #include <ctime>
+ #include <cerrno>
+#endif
+
+#if JUCE_LINUX
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+
+//==============================================================================
+#if JUCE_WINDOWS
+
+WakeSignal::WakeSignal() : semaphore(CreateSemaphoreW(nullptr, 0, 0x7fffffff, nullptr)) {}
+WakeSignal::~WakeSignal() { CloseHandle((HANDLE)semaphore); }
+
+void WakeSignal::signal()
+{
+    ReleaseSemaphore((HANDLE)semaphore, 1, nullptr);
+}
+
+bool WakeSignal::wait(int timeoutMilliseconds)
+{
+    return WaitForSingleObject((HANDLE)semaphore, (DWORD)jmax(0, timeoutMilliseconds)) == WAIT_OBJECT_0;
+}
+
+#elif JUCE_MAC || JUCE_IOS
+
+WakeSignal::WakeSignal() : semaphore(dispatch_semaphore_create(0)) {}
+WakeSignal::~WakeSignal() { dispatch_release((dispatch_semaphore_t)semaphore); }
+
+void WakeSignal::signal()
+{
+    dispatch_semaphore_signal((dispatch_semaphore_t)semaphore);
+}
+
+bool WakeSignal::wait(int timeoutMilliseconds)
+{
+    return dispatch_semaphore_wait((dispatch_semaphore_t)semaphore,
+                                   dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeoutMilliseconds * 1000000)) == 0;
+}
+
+#else
+
+WakeSignal::WakeSignal() : semaphore(new sem_t)
+{
+    sem_init(static_cast<sem_t*>(semaphore), 0, 0);
+}
+
+WakeSignal::~WakeSignal()
+{
+    sem_destroy(static_cast<sem_t*>(semaphore));
+    delete static_cast<sem_t*>(semaphore);
+}
+
+void WakeSignal::signal()
+{
+    sem_post(static_cast<sem_t*>(semaphore));
+}
+
+bool WakeSignal::wait(int timeoutMilliseconds)
+{
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeoutMilliseconds / 1000;
+    deadline.tv_nsec += (long)(timeoutMilliseconds % 1000) * 1000000;
+
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    int result;
+    while ((result = sem_timedwait(static_cast<sem_t*>(semaphore), &deadline)) != 0 && errno == EINTR) {}
+
+    return result == 0;
+}
+
+#endif
+
+//==============================================================================
+#if JUCE_LINUX
+
+bool AudioThreadPriority::startHelper(Thread& thread)
+{
+    // runs as a normal thread until it has seen the audio thread
+    return thread.startThread(Thread::Priority::high);
+}
+
+void AudioThreadPriority::capture()
+{
+    const auto current = Thread::getCurrentThreadId();
+
+    if (audioThread.load(std::memory_order_relaxed) == current)
+        return;
+
+    // once per audio thread: glibc may lock the thread descriptor here
+    int currentPolicy;
+    sched_param param;
+    if (pthread_getschedparam(pthread_self(), &currentPolicy, &param) != 0)
+        return;
+
+    audioThread.store(current, std::memory_order_relaxed);
+    policy.store(currentPolicy, std::memory_order_relaxed);
+    priority.store(param.sched_priority, std::memory_order_relaxed);
+    version.fetch_add(1, std::memory_order_release);
+}
+
+void AudioThreadPriority::follow(int& appliedVersion) const
+{
+    const int current = version.load(std::memory_order_acquire);
+
+    if (current == appliedVersion)
+        return;
+
+    // without the rights to real-time priority (rtprio) the thread keeps the one it has
+    sched_param param;
+    param.sched_priority = priority.load(std::memory_order_relaxed);
+    pthread_setschedparam(pthread_self(), policy.load(std::memory_order_relaxed), &param);
+    appliedVersion = current;
+}
+
+#else
+
+bool AudioThreadPriority::startHelper(Thread& thread)
+{
+    return thread.startRealtimeThread(Thread::RealtimeOptions{});
+}
+
+void AudioThreadPriority::capture() {}
+void AudioThreadPriority::follow(int&) const {}
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+#include <JuceHeader.h>
+
+// A wake-up the audio thread can give without taking a lock: a counting semaphore, whose post
+// only enters the kernel when a thread is waiting on it. A post with nobody waiting is kept, so
+// the waiter re-checks its condition after waking up rather than trusting the count.
+class WakeSignal
+{
+public:
+    WakeSignal();
+    ~WakeSignal();
+
+    void signal();
+
+    // false if the timeout expired first
+    bool wait(int timeoutMilliseconds);
+
+private:
+    void* semaphore;
+
+    JUCE_DECLARE_NON_COPYABLE(WakeSignal)
+};
+
+// The scheduling of the host's audio thread, for the threads that it waits for or shares its work
+// with. The audio thread records it (the system is asked only when the calling thread changes),
+// the helper threads take it over when they wake up: they never preempt the audio thread, and the
+// audio thread never waits for a thread running below it. This is done on Linux, where a host's
+// real-time audio thread is a plain SCHED_FIFO/SCHED_RR pthread; elsewhere the helpers are started
+// as JUCE real-time threads and the system schedules them with the audio threads.
+class AudioThreadPriority
+{
+public:
+    static bool startHelper(Thread& thread);
+
+    // audio thread
+    void capture();
+
+    // helper thread, appliedVersion is its own, starting at 0
+    void follow(int& appliedVersion) const;
+
+private:
+    std::atomic<Thread::ThreadID> audioThread { nullptr };
+    std::atomic<int> policy { 0 };
+    std::atomic<int> priority { 0 };
+    std::atomic<int> version { 0 };
+};
@@ -0,0 +1,276 @@
+#pragma once
+#include <JuceHeader.h>
+#include "Realtime.h"
+
+// Render-ahead pipeline: every host block is queued (MIDI and host position) for a background
+// thread, which renders it while the host plays the previous one. The audio callback only waits
+// for the block queued one callback earlier, which had a whole host period to be rendered, and
+// copies out samples rendered `latency` samples ago. The latency is the maximum block size, so a
+// spike in the rendering is hidden as long as it fits in the period. The background thread runs
+// at the priority of the audio thread, which sleeps while it waits for it.
+class RenderAhead : private Thread
+{
+public:
+    // called on the background thread for each queued block, the output buffer comes cleared
+    typedef std::function<void(AudioBuffer<float>& output, const MidiBuffer& midi, const AudioPlayHead::CurrentPositionInfo& position)> RenderFunction;
+
+    RenderAhead(RenderFunction function)
+        : Thread("Supercore ahead"), render(function) {}
+
+    ~RenderAhead()
+    {
+        stop();
+    }
+
+    // message thread, with the audio thread stopped
+    void prepare(int numChannels, int maximumBlockSize)
+    {
+        stop();
+
+        // blocks left queued when the thread was stopped are dropped
+        renderedBlocks.store(queuedBlocks.load());
+        latency = maximumBlockSize;
+
+        for (auto& block : blocks)
+        {
+            block.audio.setSize(numChannels, maximumBlockSize);
+            block.midi.ensureSize(midiCapacity);
+        }
+
+        // rendered samples lead the read position by the latency plus the block being queued, and
+        // crossfadeIn() reads back as far as a block and the latency behind what was played live
+        ring.setSize(numChannels, 4 * maximumBlockSize);
+        ring.clear();
+
+        AudioThreadPriority::startHelper(*this);
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        wakeUp.signal();
+        stopThread(1000);
+    }
+
+    int getLatency() const
+    {
+        return latency;
+    }
+
+    // audio thread: false if the MIDI of a block does not fit in what a queued block has reserved
+    static bool canQueue(const MidiBuffer& midi)
+    {
+        size_t bytes = 0;
+        for (const auto metadata : midi)
+            bytes += sizeof(int32) + sizeof(uint16) + (size_t)metadata.numBytes;
+
+        return bytes <= (size_t)midiCapacity;
+    }
+
+    // audio thread, while the background thread is idle: a block rendered live goes in the ring as
+    // well, which keeps the last samples played for crossfadeIn()
+    void recordLive(const AudioBuffer<float>& live)
+    {
+        const int numSamples = live.getNumSamples();
+        const int kept = jmin(numSamples, ring.getNumSamples());
+        const int64 rendered = renderedSamples.load(std::memory_order_relaxed) + numSamples;
+
+        if (kept > 0)
+            for (int ch = 0; ch < jmin(live.getNumChannels(), ring.getNumChannels()); ++ch)
+                copyToRing(live.getReadPointer(ch, numSamples - kept), ch, rendered - kept, kept);
+
+        renderedSamples.store(rendered, std::memory_order_release);
+    }
+
+    // audio thread, after recordLive() of the same block: enters the pipeline without a gap. The
+    // output goes `latency` samples back, so over this block the live output fades out while the
+    // same synth `latency` samples earlier, already played, fades in; the next blocks are queued.
+    void crossfadeIn(AudioBuffer<float>& live)
+    {
+        const int numSamples = live.getNumSamples();
+        jassert(numSamples <= latency);
+
+        consumedSamples = renderedSamples.load(std::memory_order_relaxed) - numSamples - latency;
+
+        for (int ch = 0; ch < jmin(live.getNumChannels(), ring.getNumChannels()); ++ch)
+        {
+            auto* output = live.getWritePointer(ch);
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const float fadeIn = (i + 1) / (float)(numSamples + 1);
+                output[i] = output[i] * (1.0f - fadeIn) + ring.getSample(ch, ringIndex(consumedSamples + i)) * fadeIn;
+            }
+        }
+
+        consumedSamples += numSamples;
+    }
+
+    // audio thread: the synth goes back to the caller once the queued blocks are rendered
+    void waitUntilIdle()
+    {
+        const int64 queued = queuedBlocks.load(std::memory_order_relaxed);
+        waitUntil([this, queued] { return renderedBlocks.load(std::memory_order_acquire) >= queued; });
+    }
+
+    // audio thread, after waitUntilIdle(): leaves the pipeline without a jump in the output. The
+    // buffer holds the synth rendered live for this block, it fades in while the output rendered
+    // ahead for the same span fades out; what was rendered ahead past it is not played.
+    void crossfadeOut(AudioBuffer<float>& live)
+    {
+        const int fadeLength = (int)jmin((int64)live.getNumSamples(), renderedSamples.load() - consumedSamples);
+
+        for (int ch = 0; ch < jmin(live.getNumChannels(), ring.getNumChannels()); ++ch)
+        {
+            auto* output = live.getWritePointer(ch);
+
+            for (int i = 0; i < fadeLength; ++i)
+            {
+                const float fadeIn = (i + 1) / (float)(fadeLength + 1);
+                output[i] = output[i] * fadeIn + ring.getSample(ch, ringIndex(consumedSamples + i)) * (1.0f - fadeIn);
+            }
+        }
+
+        consumedSamples += fadeLength;
+    }
+
+    // audio thread: queues the block, then fills the buffer with the output `latency` samples late;
+    // the MIDI must pass canQueue()
+    void process(AudioBuffer<float>& buffer, const MidiBuffer& midi, const AudioPlayHead::CurrentPositionInfo& position)
+    {
+        const int numSamples = buffer.getNumSamples();
+        jassert(numSamples <= latency);
+
+        audioThreadPriority.capture();
+
+        // with blocks shorter than the latency more than numBlocks of them can be waiting: the
+        // oldest one must be rendered before its slot is taken again
+        const int64 queued = queuedBlocks.load(std::memory_order_relaxed);
+        waitUntil([this, queued] { return renderedBlocks.load(std::memory_order_acquire) > queued - numBlocks; });
+
+        auto& block = blocks[queued % numBlocks];
+
+        block.midi.clear();
+        block.midi.addEvents(midi, 0, numSamples, 0);
+        block.position = position;
+        block.numSamples = numSamples;
+
+        queuedBlocks.store(queued + 1, std::memory_order_release);
+        wakeUp.signal();
+
+        // with numSamples <= latency this is a block queued by an earlier callback
+        waitUntil([this, numSamples] { return renderedSamples.load(std::memory_order_acquire) >= consumedSamples + numSamples; });
+
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            copyFromRing(buffer.getWritePointer(ch), ch, consumedSamples, numSamples);
+
+        consumedSamples += numSamples;
+    }
+
+private:
+    struct Block
+    {
+        AudioBuffer<float> audio;
+        MidiBuffer midi;
+        AudioPlayHead::CurrentPositionInfo position;
+        int numSamples = 0;
+    };
+
+    void run() override
+    {
+        ScopedNoDenormals noDenormals;
+        int priorityVersion = 0;
+
+        while (!threadShouldExit())
+        {
+            wakeUp.wait(100);
+            audioThreadPriority.follow(priorityVersion);
+
+            while (!threadShouldExit() && renderedBlocks.load(std::memory_order_relaxed) < queuedBlocks.load(std::memory_order_acquire))
+            {
+                const int64 index = renderedBlocks.load(std::memory_order_relaxed);
+                auto& block = blocks[index % numBlocks];
+
+                AudioBuffer<float> output(block.audio.getArrayOfWritePointers(), block.audio.getNumChannels(), block.numSamples);
+                output.clear();
+                render(output, block.midi, block.position);
+
+                const int64 rendered = renderedSamples.load(std::memory_order_relaxed);
+                for (int ch = 0; ch < ring.getNumChannels(); ++ch)
+                    copyToRing(output.getReadPointer(ch), ch, rendered, block.numSamples);
+
+                renderedSamples.store(rendered + block.numSamples, std::memory_order_release);
+                renderedBlocks.store(index + 1, std::memory_order_release);
+
+                // a store then a load, as in waitUntil(): only a full fence on both sides orders them
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (audioWaiting.load(std::memory_order_relaxed))
+                    blockRendered.signal();
+            }
+        }
+    }
+
+    // audio thread: spins for a moment, then sleeps until the background thread has rendered a block
+    template <typename Condition>
+    void waitUntil(Condition isDone)
+    {
+        for (int spin = 0; spin < spinsBeforeSleeping; ++spin)
+            if (isDone())
+                return;
+
+        while (!isDone())
+        {
+            audioWaiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (!isDone())
+                blockRendered.wait(1);
+
+            audioWaiting.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    int ringIndex(int64 sample) const
+    {
+        const int size = ring.getNumSamples();
+        return (int)(((sample % size) + size) % size);
+    }
+
+    void copyToRing(const float* source, int channel, int64 start, int numSamples)
+    {
+        const int first = ringIndex(start);
+        const int firstPart = jmin(numSamples, ring.getNumSamples() - first);
+
+        FloatVectorOperations::copy(ring.getWritePointer(channel, first), source, firstPart);
+        FloatVectorOperations::copy(ring.getWritePointer(channel, 0), source + firstPart, numSamples - firstPart);
+    }
+
+    void copyFromRing(float* destination, int channel, int64 start, int numSamples) const
+    {
+        const int first = ringIndex(start);
+        const int firstPart = jmin(numSamples, ring.getNumSamples() - first);
+
+        FloatVectorOperations::copy(destination, ring.getReadPointer(channel, first), firstPart);
+        FloatVectorOperations::copy(destination + firstPart, ring.getReadPointer(channel, 0), numSamples - firstPart);
+    }
+
+    static constexpr int numBlocks = 8;
+    static constexpr int midiCapacity = 16384;
+    static constexpr int spinsBeforeSleeping = 1000;
+
+    RenderFunction render;
+    Block blocks[numBlocks];
+    AudioBuffer<float> ring;
+    int latency = 0;
+    WakeSignal wakeUp;                           // to the background thread
+    WakeSignal blockRendered;                    // to the audio thread, while audioWaiting is set
+    AudioThreadPriority audioThreadPriority;
+
+    std::atomic<int64> queuedBlocks { 0 };       // written by the audio thread
+    std::atomic<int64> renderedBlocks { 0 };     // written by the background thread
+    std::atomic<int64> renderedSamples { 0 };    // written by the background thread, or by recordLive()
+    std::atomic<bool> audioWaiting { false };    // written by the audio thread
+    int64 consumedSamples = 0;                   // audio thread
+
+    JUCE_DECLARE_NON_COPYABLE(RenderAhead)
+};
@@ -0,0 +1,207 @@
+#pragma once
+#include <JuceHeader.h>
+#include "Realtime.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+#define MAX_RENDER_WORKERS 15
+
+// Helper threads for the audio thread: run(numJobs, ...) executes job(context, i) for every i in
+// [0, numJobs) on the calling thread and on the workers, and returns when all the jobs are done.
+// Nothing is allocated or locked once the workers are running: jobs are claimed from a single
+// atomic counter tagged with the batch generation, so a worker late on a previous batch cannot
+// take a job of the next one. Workers spin for a moment after each batch (chunks of the same block
+// follow each other closely) and then sleep, the audio thread wakes only the sleeping ones.
+// There is one pool per process, held through a SharedResourcePointer<RenderWorkers>: a batch
+// started while another instance of the plug-in is using it is rendered by its own audio thread.
+// The workers run at the priority of the audio thread that last used them.
+class RenderWorkers
+{
+public:
+    typedef void (*JobFunction)(void* context, int jobIndex);
+
+    RenderWorkers()
+        : RenderWorkers(SystemStats::getNumCpus() - 1) {}
+
+    RenderWorkers(int numThreads)
+    {
+        numThreads = jlimit(0, MAX_RENDER_WORKERS, numThreads);
+
+        for (int i = 0; i < numThreads; ++i)
+            workers.add(new Worker(*this, i));
+
+        for (auto* worker : workers)
+            AudioThreadPriority::startHelper(*worker);
+    }
+
+    ~RenderWorkers()
+    {
+        for (auto* worker : workers)
+            worker->signalThreadShouldExit();
+
+        for (auto* worker : workers)
+        {
+            worker->wakeUp.signal();
+            worker->stopThread(1000);
+        }
+    }
+
+    int getNumThreads() const
+    {
+        return workers.size();
+    }
+
+    // audio thread: at most maxThreads workers help with the batch
+    void run(int numJobs, int maxThreads, JobFunction function, void* context)
+    {
+        // another instance is using the pool: the batch is rendered here, one job after the other
+        if (busy.exchange(true, std::memory_order_acquire))
+        {
+            for (int i = 0; i < numJobs; ++i)
+                function(context, i);
+            return;
+        }
+
+        audioThreadPriority.capture();
+        const int numHelpers = jmin(maxThreads, workers.size());
+
+        jobFunction.store(function, std::memory_order_relaxed);
+        jobContext.store(context, std::memory_order_relaxed);
+        batchSize.store(numJobs, std::memory_order_relaxed);
+        allowedWorkers.store(numHelpers, std::memory_order_relaxed);
+        jobsDone.store(0, std::memory_order_relaxed);
+
+        // sequentially consistent, like the flag of the workers: see waitForBatch()
+        const uint64 generation = (jobState.load(std::memory_order_relaxed) >> 32) + 1;
+        jobState.store(generation << 32, std::memory_order_seq_cst);
+
+        for (int i = 0; i < numHelpers; ++i)
+            if (workers[i]->sleeping.load(std::memory_order_seq_cst))
+                workers[i]->wakeUp.signal();
+
+        runJobs(generation);
+
+        while (jobsDone.load(std::memory_order_acquire) < numJobs)
+            spinPause();
+
+        busy.store(false, std::memory_order_release);
+    }
+
+private:
+    class Worker : public Thread
+    {
+    public:
+        // Linux leaves a thread unnamed beyond 15 characters
+        Worker(RenderWorkers& owner, int index)
+            : Thread("Supercore wk " + String(index)), workers(owner), workerIndex(index) {}
+
+        void run() override
+        {
+            ScopedNoDenormals noDenormals;
+
+            uint64 lastGeneration = 0;
+            int priorityVersion = 0;
+
+            while (!threadShouldExit())
+            {
+                workers.audioThreadPriority.follow(priorityVersion);
+
+                // a worker left out of the batches sleeps instead of spinning
+                const bool helping = workerIndex < workers.allowedWorkers.load(std::memory_order_relaxed);
+                const uint64 generation = workers.waitForBatch(*this, lastGeneration, helping);
+
+                if (generation == lastGeneration)
+                    continue;
+
+                lastGeneration = generation;
+
+                if (workerIndex < workers.allowedWorkers.load(std::memory_order_relaxed))
+                    workers.runJobs(generation);
+            }
+        }
+
+        WakeSignal wakeUp;
+        std::atomic<bool> sleeping { false };
+
+    private:
+        RenderWorkers& workers;
+        const int workerIndex;
+    };
+
+    // returns the generation of the batch to work on, lastGeneration if there is none yet
+    uint64 waitForBatch(Worker& worker, uint64 lastGeneration, bool spinFirst)
+    {
+        for (int spin = 0; spinFirst && spin < spinsBeforeSleeping; ++spin)
+        {
+            const uint64 generation = jobState.load(std::memory_order_acquire) >> 32;
+
+            if (generation != lastGeneration || worker.threadShouldExit())
+                return generation;
+
+            spinPause();
+        }
+
+        // checked again after raising the flag, so a batch published meanwhile is not missed: a store
+        // then a load on each side, which only sequential consistency orders
+        worker.sleeping.store(true, std::memory_order_seq_cst);
+
+        if ((jobState.load(std::memory_order_seq_cst) >> 32) == lastGeneration)
+            worker.wakeUp.wait(100);
+
+        worker.sleeping.store(false, std::memory_order_relaxed);
+
+        return jobState.load(std::memory_order_acquire) >> 32;
+    }
+
+    void runJobs(uint64 generation)
+    {
+        for (;;)
+        {
+            uint64 state = jobState.load(std::memory_order_acquire);
+
+            if ((state >> 32) != generation)
+                return;
+
+            const int jobIndex = (int)(state & 0xffffffff);
+
+            if (jobIndex >= batchSize.load(std::memory_order_relaxed))
+                return;
+
+            if (!jobState.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel))
+                continue;
+
+            jobFunction.load(std::memory_order_relaxed)(jobContext.load(std::memory_order_relaxed), jobIndex);
+            jobsDone.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    static void spinPause()
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #else
+        std::this_thread::yield();
+       #endif
+    }
+
+    // a few microseconds, enough to bridge the chunks of a block
+    static constexpr int spinsBeforeSleeping = 2000;
+
+    OwnedArray<Worker> workers;
+    AudioThreadPriority audioThreadPriority;
+    std::atomic<bool> busy { false };   // a batch is running
+
+    // batch description, written by the audio thread before the generation is published
+    std::atomic<JobFunction> jobFunction { nullptr };
+    std::atomic<void*> jobContext { nullptr };
+    std::atomic<int> batchSize { 0 };
+    std::atomic<int> allowedWorkers { 0 };
+
+    // generation of the batch in the high half, next job to claim in the low half
+    std::atomic<uint64> jobState { 0 };
+    std::atomic<int> jobsDone { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(RenderWorkers)
+};
@@ -17,6 +17,9 @@
 //==============================================================================
 SupersawEditor::SupersawEditor (DemoSynthAudioProcessor& p, AudioProcessorValueTreeState& vts)
     : AudioProcessorEditor (&p), audioProcessor (p), valueTreeState(vts)
+#if SUPERCORE_PROFILING
+    , cpuPanel(p.getProfiler())
+#endif
 {
     mainWaveformSlider.setName("wf");
     lfoWaveformSlider.setName("wf2");
@@ -91,6 +94,12 @@ SupersawEditor::SupersawEditor (DemoSynthAudioProcessor& p, AudioProcessorValueT
         lfoFreqSlider.setVisible(!syncOn);
     };
     
+#if SUPERCORE_PROFILING
+    // below the LFO, where the editor has room
+    addAndMakeVisible(cpuPanel);
+    cpuPanel.setBounds(800, 300, 140, 200);
+#endif
+
     loadWaveIcons();
 //    loadWaveIcons2();
     
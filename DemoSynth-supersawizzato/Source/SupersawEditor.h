@@ -13,6 +13,7 @@
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
 #include "SupersawTheme.h"
+#include "CpuPanel.h"
 
 typedef AudioProcessorValueTreeState::SliderAttachment SliderAttachment;
 
@@ -68,6 +69,9 @@ private:
     Slider masterSlider;    
     
     SupersawLookAndFeel supersawTheme;
+#if SUPERCORE_PROFILING
+    CpuPanel cpuPanel;
+#endif
 
     std::unique_ptr<SliderAttachment> mainWfAtttachment;
     std::unique_ptr<SliderAttachment> mainRegAtttachment;
@@ -5,29 +5,20 @@
 #include "MyADSR.h"
 #include "Mixer.h"
 #include "Oversampling.h"
+#include "PolySynth.h"
+#include "LevelTracker.h"
+#include "PluginParameters.h"
+#include "Profiling.h"
+#include "VoiceArena.h"
 
 #define VELOCITY_DYN_RANGE 9.0f  //dB;
 
-class MySynthSound : public SynthesiserSound
-{
-public:
-	MySynthSound() {}
-	~MySynthSound() {}
-
-	bool appliesToNote(int midiNoteNumber) override { return true; }
-	bool appliesToChannel(int midiChannel) override { return true; }
-
-private:
-	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MySynthSound)
-};
-
-
-class SimpleSynthVoice : public SynthesiserVoice
+class SimpleSynthVoice : public SynthVoice
 {
 public:
 	SimpleSynthVoice( int defaultSawNum = 5, int defaultDetune = 15, /*float defaultPhase = 0.0f,*/ float defaultStereoWidth = 0.0f,
                      /*int defaultSubReg = 3,*/ float defaultEnvAmt = 0.0f, double defaultLfoFreq = 0.01, int defaultLfoWf = 0)
-    : sawOscs(defaultSawNum, defaultDetune, defaultStereoWidth), /*subRegister(defaultSubReg),*/ egAmt(defaultEnvAmt), subOscillator(20.0, 0), lfo(defaultLfoFreq, defaultLfoWf)
+    : sawOscs(defaultSawNum, defaultDetune, defaultStereoWidth), /*subRegister(defaultSubReg),*/ egAmt(defaultEnvAmt), subOscillator(20.0), lfo(defaultLfoFreq, defaultLfoWf)
 	{
 //        moogFilter.setCutoff(4000);
 //        moogFilter.setResonance(0.0f);
@@ -35,11 +26,10 @@ public:
 	
 	~SimpleSynthVoice() {};
 
-	bool canPlaySound(SynthesiserSound* sound) override
-	{
-		return dynamic_cast<MySynthSound*>(sound) != nullptr;
-	}
-    
+    // voices start on a cache line, so the state of two voices rendered on different cores never shares one
+    static void* operator new(size_t size)   { return VoiceArena::allocateAligned(size); }
+    static void operator delete(void* pointer)   { VoiceArena::freeAligned(pointer); }
+
     void releaseResources()
     {
         sawOscs.releaseResources();
@@ -52,9 +42,11 @@ public:
         modulation.setSize(0, 0);
         frequencyBuffer.setSize(0, 0);
         filterEnvBuffer.setSize(0, 0);
+        arena.release();
+        preparedSampleRate = 0.0;
     }
 
-	void startNote(int midiNoteNumber, float velocity, SynthesiserSound* sound, int currentPitchWheelPosition) override
+	void startNote(int midiNoteNumber, float velocity, int currentPitchWheelPosition) override
 	{
 //        oversmpBuffer.clear();
 //        oscillatorBuffer.clear();
@@ -67,6 +59,9 @@ public:
         
         currentMidiNote = midiNoteNumber;
         sawOscs.startNote();
+        // idle voices do not follow the host, the LFO catches up when the note starts
+        if (hostPosition != nullptr)
+            lfo.updatePosition(*hostPosition);
         // storing currentMidiNote for parameter changes related to the frequency
         noteNumber.setTargetValue(currentMidiNote);
         
@@ -76,6 +71,8 @@ public:
 //        oSmp.resetFilter(); // modify: delete if not needed        
 
 		// Trigger the ADSR
+        released = false;
+        levelTracker.reset();
         ampAdsr.noteOn();
         filterAdsr.noteOn();
 		filterAdsr.noteOn();
@@ -91,6 +88,7 @@ public:
         ampAdsr.noteOff();
         filterAdsr.noteOff();
 		filterAdsr.noteOff();
+        released = true;
 
 		// signaling that this voice is now free process new sounds
         if (!allowTailOff || ( !ampAdsr.isActive() /*&& noiseOsc.envFinished()*/))
@@ -103,52 +101,102 @@ public:
 
 	void renderNextBlock(AudioBuffer<float>& outputBuffer, int startSample, int numSamples) override
 	{
-        lfo.getNextAudioBlock(modulation, startSample, numSamples);
-        
-        // modify: I might move this to after the initial return
-        frequencyModulation(startSample, numSamples);
-        
 		if (!isVoiceActive())
 			return;
         
-        oversmpBuffer.clear();
-		oscillatorBuffer.clear();
-        subBuffer.clear();
-        noiseBuffer.clear();
-        mixerBuffer.clear();
-
+        {
+            SUPERCORE_PROFILE_STAGE(profiler, modulation);
+            lfo.getNextAudioBlock(modulation, startSample, numSamples);
+            frequencyModulation(startSample, numSamples);
+        }
+        
         const int startSampleOS = startSample * oversamplingFactor;
         const int numSamplesOS = numSamples * oversamplingFactor;
+
+        // only the range being rendered is cleared, and only where the stages accumulate:
+        // the decimator and the sub overwrite their buffers, the noise may write just part of it
+        oversmpBuffer.clear(startSampleOS, numSamplesOS);
+        noiseBuffer.clear(startSample, numSamples);
+        mixerBuffer.clear(startSample, numSamples);
         
         // 2X OVERSAMPLING -- generate sounds at oversampled sample rate and decimate to original sample rate
-        sawOscs.process(oversmpBuffer, frequencyBuffer, startSampleOS, numSamplesOS);
-        oSmp.filterAndDecimate(oversmpBuffer, oscillatorBuffer, startSampleOS, numSamplesOS, oversamplingFactor);
+        // sources at the level floor are only advanced, the mixer leaves them out
+        if (mixer.getSawGain() == 0.0f)
+        {
+            SUPERCORE_PROFILE_STAGE(profiler, saws);
+            sawOscs.skip(frequencyIsConstant ? constantFrequency
+                                             : frequencyBuffer.getSample(0, startSampleOS + numSamplesOS / 2), numSamplesOS);
+            sawsSkipped = true;
+        }
+        else
+        {
+            // the decimator's history is from before the saws were skipped: it starts again from
+            // silence, like the saws coming back from the level floor
+            if (sawsSkipped)
+            {
+                oSmp.resetFilter();
+                sawsSkipped = false;
+            }
+            {
+                SUPERCORE_PROFILE_STAGE(profiler, saws);
+                if (frequencyIsConstant)
+                    sawOscs.process(oversmpBuffer, constantFrequency, startSampleOS, numSamplesOS);
+                else
+                    sawOscs.process(oversmpBuffer, frequencyBuffer, startSampleOS, numSamplesOS);
+            }
+            SUPERCORE_PROFILE_STAGE(profiler, decimator);
+            oSmp.filterAndDecimate(oversmpBuffer, oscillatorBuffer, startSampleOS, numSamplesOS, oversamplingFactor);
+        }
         
-        subOscillator.getNextAudioBlockFloat(subBuffer, startSample, numSamples);
-        // noise: trigger the ReleaseFilter envelope
-        if(trigger)
         {
-            noiseOsc.trigger(startSample, velocityLevel);
-            trigger = false;
+            SUPERCORE_PROFILE_STAGE(profiler, sub);
+            if (mixer.getSubGain() == 0.0f)
+                subOscillator.skip(numSamples);
+            else
+                subOscillator.getNextAudioBlock(subBuffer, startSample, numSamples);
+        }
+        {
+            SUPERCORE_PROFILE_STAGE(profiler, noise);
+            // noise: trigger the ReleaseFilter envelope
+            if(trigger)
+            {
+                noiseOsc.trigger(startSample, velocityLevel);
+                trigger = false;
+            }
+            // the noise comes out already filtered with its colour parameter, before the main LPF
+            noiseOsc.process(noiseBuffer, startSample, numSamples, mixer.getNoiseGain());
+        }
+        {
+            SUPERCORE_PROFILE_STAGE(profiler, mixer);
+            mixer.getNextAudioBlock(mixerBuffer, oscillatorBuffer, subBuffer, noiseBuffer, startSample, numSamples, velocityLevel, sawOscs.getActiveOscs());
         }
-        noiseOsc.process(noiseBuffer, startSample, numSamples, mixer.getNoiseGain());
-        // filtering the noise with its parameter before the main LPF
-//        noiseFilter.processBlock(noiseBuffer, numSamples);
-        noiseFilter.processBlock(noiseBuffer, startSample, numSamples);
-
-        mixer.getNextAudioBlock(mixerBuffer, oscillatorBuffer, subBuffer, noiseBuffer, startSample, numSamples, velocityLevel, sawOscs.getActiveOscs());
         
         // FILTERING - process the mixed buffer through a ladder filter
         // to filter with the EG and LFO, we must get ADSR and LFO values then modulate the cutoff with their values
-        moogFilter.process(mixerBuffer, filterEnvBuffer, modulation, startSample, numSamples);
+        {
+            SUPERCORE_PROFILE_STAGE(profiler, filter);
+            moogFilter.process(mixerBuffer, filterEnvBuffer, modulation, startSample, numSamples);
+        }
+#if SUPERCORE_PROFILING
+        if (profiler != nullptr)
+            moogFilter.collectNewtonIterations(*profiler);
+#endif
 
-        ampAdsr.applyEnvelopeToBuffer(mixerBuffer, startSample, numSamples);
-         
-        mixer.applyMasterGainAndCopy(outputBuffer, mixerBuffer, startSample, numSamples);
+        bool silenced = false;
+        {
+            SUPERCORE_PROFILE_STAGE(profiler, amp);
+            ampAdsr.applyEnvelopeToBuffer(mixerBuffer, startSample, numSamples);
+
+            // level before the master gain: a released voice that stays inaudible is faded out and ended
+            levelTracker.process(mixerBuffer, startSample, numSamples, released);
+            silenced = levelTracker.applyFade(mixerBuffer, startSample, numSamples);
+             
+            mixer.applyMasterGainAndCopy(outputBuffer, mixerBuffer, startSample, numSamples);
+        }
 
 		// Se gli ADSR hanno finito la fase di decay (o se ho altri motivi per farlo)
 		// segno la voce come libera per suonare altre note
-        if (!ampAdsr.isActive() && noiseOsc.envFinished())
+        if (silenced || (!ampAdsr.isActive() && noiseOsc.envFinished()))
         {
             clearCurrentNote();
             trigger = false;
@@ -159,6 +207,14 @@ public:
 
 	void prepareToPlay(double sampleRate, int samplesPerBlock)
 	{
+        // a host preparing again with the same settings finds the buffers and tables in place,
+        // only the state of the previous run is cleared
+        if (sampleRate == preparedSampleRate && samplesPerBlock == preparedBlockSize && oversamplingFactor == preparedOversampling)
+        {
+            resetState();
+            return;
+        }
+
         const int sampleRateOs = sampleRate * oversamplingFactor;
         const int samplesPerBlockOs = samplesPerBlock * oversamplingFactor;
         // for the mono sounds, i.e. sub and noise
@@ -170,34 +226,132 @@ public:
         stereoOversampledSpec.sampleRate = sampleRateOs;
         stereoOversampledSpec.numChannels = 2;
              
-        oversmpBuffer.setSize(2, samplesPerBlockOs);
-        oscillatorBuffer.setSize(2, samplesPerBlock);
-        subBuffer.setSize(1, samplesPerBlock);
-        noiseBuffer.setSize(1, samplesPerBlock);
-        mixerBuffer.setSize(2, samplesPerBlock);
-        modulation.setSize(2, samplesPerBlock);
-        filterEnvBuffer.setSize(1, samplesPerBlock);
-        frequencyBuffer.setSize(1, samplesPerBlockOs);
+        // one allocation for all the scratch buffers, in the order renderNextBlock goes through them
+        arena.prepare([&] (VoiceArena& a)
+        {
+            a.place(modulation, 2, samplesPerBlock);
+            a.place(frequencyBuffer, 1, samplesPerBlockOs);
+            a.place(oversmpBuffer, 2, samplesPerBlockOs);
+            sawOscs.placeBuffers(a, samplesPerBlockOs);
+            a.place(oscillatorBuffer, 2, samplesPerBlock);
+            a.place(subBuffer, 1, samplesPerBlock);
+            a.place(noiseBuffer, 1, samplesPerBlock);
+            a.place(mixerBuffer, 2, samplesPerBlock);
+            a.place(filterEnvBuffer, 1, samplesPerBlock);
+        });
         
         // initializing oscillators, noise generator and filters, mixer etc.
         oSmp.prepareToPlay(sampleRateOs, sampleRate, samplesPerBlockOs);
         sawOscs.prepareToPlay(stereoOversampledSpec);
         subOscillator.prepareToPlay(sampleRate);
         noiseOsc.prepareToPlay(spec);
-        noiseFilter.prepareToPlay(spec);
         moogFilter.prepareToPlay(sampleRate);
         lfo.prepareToPlay(sampleRate);
         ampAdsr.prepareToPlay(sampleRate);
         filterAdsr.prepareToPlay(sampleRate);
         mixer.prepareToPlay(sampleRate);
+        levelTracker.prepareToPlay(sampleRate);
         noteNumber.reset(sampleRate, 0.001f);
+
+        // every page of the scratch buffers is written here rather than by the first note
+        arena.prefault();
+        resetState();
+
+        preparedSampleRate = sampleRate;
+        preparedBlockSize = samplesPerBlock;
+        preparedOversampling = oversamplingFactor;
 	}
     
+    // nothing rendered before the prepare is heard after it: filters, envelopes, decimator and
+    // oscillators start again from rest, the parameters are kept
+    void resetState()
+    {
+        oSmp.resetFilter();
+        sawOscs.reset();
+        subOscillator.reset();
+        noiseOsc.reset();
+        moogFilter.reset();
+        lfo.resetPhase();
+        ampAdsr.reset();
+        filterAdsr.reset();
+        levelTracker.reset();
+        noteNumber.setCurrentAndTargetValue(noteNumber.getTargetValue());
+        sawsSkipped = false;
+        trigger = false;
+    }
+    
+    // 2 in the plugin, takes effect at the next prepareToPlay
+    void setOversamplingFactor(const int newValue)
+    {
+        oversamplingFactor = jmax(1, newValue);
+    }
+    
     void updatePosition(AudioPlayHead::CurrentPositionInfo newPosition)
     {
         lfo.updatePosition(newPosition);
     }
+    
+    // position of the current host block, owned by the processor
+    void setHostPosition(const AudioPlayHead::CurrentPositionInfo* newPosition)
+    {
+        hostPosition = newPosition;
+    }
+    
+    // the stage timers report here, owned by the processor; only fed in SUPERCORE_PROFILING builds
+    void setProfiler(Profiling::Profiler* newProfiler)
+    {
+        profiler = newProfiler;
+    }
 	
+    // value of the parameter at index (Parameters::Index), in the units of the plugin parameter
+    void setParameter(const int index, const float newValue)
+    {
+        switch (index)
+        {
+        // OSC
+        case Parameters::mainWf:      setMainWf(newValue); break;
+        case Parameters::sawReg:      setSawRegister(newValue); break;
+        case Parameters::sawNum:      setSawNum(newValue); break;
+        case Parameters::detune:      setSawDetune(newValue); break;
+        case Parameters::stereoWidth: setSawStereoWidth(newValue); break;
+        case Parameters::phase:       setPhaseResetting(newValue); break;
+
+        // OSC levels
+        case Parameters::sawLev:      setSawGain(Decibels::decibelsToGain(newValue, Parameters::dbFloor)); break;
+        case Parameters::subLev:      setSubGain(Decibels::decibelsToGain(newValue, Parameters::dbFloor)); break;
+        case Parameters::nLev:        setNoiseGain(Decibels::decibelsToGain(newValue, Parameters::dbFloor)); break;
+
+        // ADSR
+        case Parameters::atk:         setAttack(newValue); break;
+        case Parameters::dcy:         setDecay(newValue); break;
+        case Parameters::sus:         setSustain(newValue); break;
+        case Parameters::rel:         setRelease(newValue); break;
+
+        // SUB
+        case Parameters::subReg:      setSubReg(roundToInt(newValue)); break;
+        case Parameters::subWf:       setSubWf(roundToInt(newValue)); break;
+
+        // FILTER
+        case Parameters::filtHz:      setCutoff(newValue); break;
+        case Parameters::filtQ:       setQuality(newValue); break;
+        case Parameters::nRel:        setNoiseRelease(newValue); break;
+        case Parameters::nFilt:       setNoiseFilterCutoff(newValue); break;
+        case Parameters::filtEnv:     setFilterEnvAmt(newValue); break;
+
+        // FILTER & LFO
+        case Parameters::filtLfoAmt:  setFilterLfoAmt(newValue); break;
+        case Parameters::lfoWf:       setLfoWf(newValue); break;
+        case Parameters::lfoFreq:     setLfoFreq(newValue); break;
+        case Parameters::lfoRate:     setLfoRate(newValue); break;
+        case Parameters::lfoSync:     setLfoSync(newValue); break;
+
+        case Parameters::master:      setMasterGain(newValue); break;
+        case Parameters::silence:     setSilenceThreshold(newValue); break;
+
+        default: break; // engine parameters (VOICES, THREADS, ...) are not voice settings
+        }
+    }
+
     // Parameter setters
     
     void setMainWf(const int newValue)
@@ -282,13 +436,13 @@ public:
         switch (newValue)
         {
         case 0: // sinusoidal
-            subOscillator.setWaveform(0);
+            subOscillator.setWaveform(SubOscillator::sine);
             break;
         case 1: // square
-            subOscillator.setWaveform(3);
+            subOscillator.setWaveform(SubOscillator::square);
             break;
         default:
-            subOscillator.setWaveform(0);
+            subOscillator.setWaveform(SubOscillator::sine);
             break;
         }
         updateFreqs();
@@ -304,6 +458,12 @@ public:
         moogFilter.setResonance(newValue);
     }
     
+    // iteration cap of the ladder's Newton-Raphson solver, per sample
+    void setMaxNewtonIterations(const int newValue)
+    {
+        moogFilter.setMaxNewtonIterations(newValue);
+    }
+    
     void setFilterEnvAmt(const float newValue)
     {
         moogFilter.setEnvAmt(newValue);
@@ -336,7 +496,7 @@ public:
     
     void setNoiseFilterCutoff(const float newValue)
     {
-        noiseFilter.setFrequency(newValue);
+        noiseOsc.setColour(newValue);
     }
     
     void setNoiseRelease(const float newValue)
@@ -348,6 +508,16 @@ public:
     {
         mixer.setMasterGain(newValue);
     }
+
+    void setSilenceThreshold(const float newValue)
+    {
+        levelTracker.setThreshold(newValue);
+    }
+
+    float getCurrentLevel() const override
+    {
+        return levelTracker.getLevel();
+    }
     
 private:
     
@@ -368,7 +538,16 @@ private:
         auto fmOsc1Data = frequencyBuffer.getArrayOfWritePointers();
         filterAdsr.getEnvelopeBuffer(filterEnvBuffer, startSample, numSamples);
         
-        for (int i = startSample; i < numSamples; ++i)
+        // the note is not gliding: the oscillators get a single frequency for the whole block
+        frequencyIsConstant = !noteNumber.isSmoothing();
+        if (frequencyIsConstant)
+        {
+            constantFrequency = nn2hz(noteNumber.getTargetValue() + (sawRegister - 3) * 12);
+            return;
+        }
+        
+        const int endSample = startSample + numSamples;
+        for (int i = startSample; i < endSample; ++i)
         {
             const double currentNoteNumber = noteNumber.getNextValue();
             const double note = nn2hz(currentNoteNumber + (sawRegister - 3) * 12);
@@ -381,30 +560,41 @@ private:
     
     dsp::ProcessSpec spec;
     dsp::ProcessSpec stereoOversampledSpec;
+    // what prepareToPlay last set up, 0 when released
+    double preparedSampleRate = 0.0;
+    int preparedBlockSize = 0;
+    int preparedOversampling = 0;
     Oversampling oSmp;
     int oversamplingFactor = 2;
     
     SawOscillators sawOscs;
     NoiseOsc noiseOsc;
-    NaiveOscillator subOscillator;
+    SubOscillator subOscillator;
     NaiveOscillator lfo;
     
     // to track detune, register parameters on active note
     int sawRegister = 2;
     int subRegister = 2;
     int currentMidiNote = 60;
+    const AudioPlayHead::CurrentPositionInfo* hostPosition = nullptr;
+    Profiling::Profiler* profiler = nullptr;
     SmoothedValue<double, ValueSmoothingTypes::Linear> noteNumber;
     AudioBuffer<double> frequencyBuffer;
+    // when the note is not gliding frequencyBuffer is not filled, constantFrequency is used instead
+    bool frequencyIsConstant = false;
+    double constantFrequency = 440.0;
+    bool sawsSkipped = false;   // the saws were at the level floor, the decimator was not run
     AudioBuffer<double> filterEnvBuffer;
 
 	MyADSR ampAdsr;         // double ADSR
     MyADSR filterAdsr;      // EG used for the filter
     bool trigger = false;   // used for triggering the noise envelope
+    bool released = false;  // the note is in its release tail
+    LevelTracker levelTracker;
     Mixer mixer;
     
     // filters
     MoogFilters moogFilter;             // LPF for the whole synth
-    NoiseFilter noiseFilter;           // filter for noise
     float egAmt = 0.0f;
     
     // buffers
@@ -414,6 +604,7 @@ private:
     AudioBuffer<float> noiseBuffer;
     AudioBuffer<float> mixerBuffer;
     AudioBuffer<double> modulation;
+    VoiceArena arena;       // where all the buffers above are
 	float velocityLevel = 0.7f;
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SimpleSynthVoice)
@@ -0,0 +1,105 @@
+#pragma once
+#include <JuceHeader.h>
+
+// The scratch buffers of a voice, carved out of one block allocated at prepare time. Every channel
+// starts on a cache line and the block is a whole number of lines, so two voices rendered on
+// different cores never write to the same line, and a block touches one contiguous range.
+class VoiceArena
+{
+public:
+    static const size_t cacheLine = 64;
+
+    // memory starting on a cache line and ending on one, for anything rendered concurrently
+    static void* allocateAligned(const size_t size)
+    {
+        auto* block = static_cast<char*>(std::malloc(roundUp(size) + cacheLine + sizeof(void*)));
+        if (block == nullptr)
+            throw std::bad_alloc();
+
+        auto* aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<size_t>(block + sizeof(void*))));
+        reinterpret_cast<void**>(aligned)[-1] = block;
+        return aligned;
+    }
+
+    static void freeAligned(void* pointer)
+    {
+        if (pointer != nullptr)
+            std::free(reinterpret_cast<void**>(pointer)[-1]);
+    }
+
+    VoiceArena() {}
+
+    ~VoiceArena()
+    {
+        freeAligned(base);
+    }
+
+    // layout() calls place() for every buffer: once to size the block, then again, after the only
+    // allocation (none if the block is already big enough), to point the buffers into it
+    template <typename Layout>
+    void prepare(Layout layout)
+    {
+        placing = false;
+        used = 0;
+        layout(*this);
+
+        if (used > capacity)
+        {
+            freeAligned(base);
+            base = static_cast<char*>(allocateAligned(used));
+            capacity = used;
+        }
+
+        placing = true;
+        used = 0;
+        layout(*this);
+    }
+
+    template <typename Type>
+    void place(AudioBuffer<Type>& buffer, const int numChannels, const int numSamples)
+    {
+        jassert(numChannels <= maxChannels);
+        Type* channels[maxChannels];
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            channels[ch] = placing ? reinterpret_cast<Type*>(base + used) : nullptr;
+            used += roundUp((size_t)numSamples * sizeof(Type));
+        }
+
+        if (placing)
+            buffer.setDataToReferTo(channels, numChannels, numSamples);
+    }
+
+    // writes the whole block, so that its pages are mapped before the audio thread gets to them
+    void prefault()
+    {
+        if (base != nullptr)
+            std::memset(base, 0, capacity);
+    }
+
+    // the buffers placed in the arena must be resized or placed again before they are used
+    void release()
+    {
+        freeAligned(base);
+        base = nullptr;
+        capacity = 0;
+    }
+
+    size_t getSize() const { return capacity; }
+
+private:
+    static size_t roundUp(const size_t size)
+    {
+        return (size + cacheLine - 1) & ~(cacheLine - 1);
+    }
+
+    static const int maxChannels = 2;
+
+    char* base = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    bool placing = false;
+
+    JUCE_DECLARE_NON_COPYABLE(VoiceArena)
+};